@@ -1,55 +1,78 @@
 #include "Activation.h"
+#include "ActivationKernels.h"
 
 
 /**
 * get type of activationType
 * @return activationType of obj
 */
-ActivationType Activation::get_activation_type () {
+ActivationType Activation::get_activation_type () const {
   return _activation_type;
 }
 
 /**
-* if m[i]<0 we cheng it to 0 and else we do nothing
+* Applies activation function on input
 * @param m matrix
-* @return new matrix
+* @return the activation function
 */
-Matrix Activation::relu (Matrix const &m) const {
-  Matrix copy_vec = m;
-  for (int i = 0; i < m.get_cols () * m.get_rows (); ++i) {
-    if (copy_vec[i] < 0) {
-      copy_vec[i] = 0;
-    }
-  }
-  return copy_vec;
+Matrix Activation::operator() (const Matrix &m) const {
+  return (*this) (Matrix (m));
 }
 
 /**
-* Returns a matrix according to the formula provided in the exercise
+* Applies activation function on a temporary input, reusing its elements
 * @param m matrix
-* @return new matrix
+* @return the activation function
 */
-Matrix Activation::softmax (Matrix const &m) const {
-  float sum = 0;
-  Matrix copy_vec = m;
-  for (int i = 0; i < m.get_cols () * m.get_rows (); ++i) {
-    copy_vec[i] = std::exp (m[i]);
-    sum +=  copy_vec[i];
+Matrix Activation::operator() (Matrix &&m) const {
+  if (!m.owns_data ()) {
+    // a temporary view still refers to elements it must not write
+    return (*this) (Matrix (m));
   }
-  float scalar = (1 / sum);
-  return scalar * copy_vec;
+  // the padding of padded rows is skipped, so it stays zero
+  apply (m.data (), m.get_rows (), m.get_cols (), m.get_ld ());
+  return std::move (m);
 }
 
 /**
-* Applies activation function on input
-* @param m matrix
-* @return the activation function
+* Applies activation function in place. Softmax normalizes every column
+* on its own, so a batch of vectors (one per column) gets the same result
+* as running softmax on each of them; the other functions are element
+* wise.
+* @param data rows x cols values stored row by row, one vector per column
+* @param rows length of every vector
+* @param cols number of vectors
+* @param ld floats between two stored rows, 0 for cols (the padding past
+* cols is not touched)
 */
-Matrix Activation::operator() (const Matrix &m) const {
-  if (_activation_type == RELU) {
-    return relu (m);
+void Activation::apply (float *data, int rows, int cols, int ld) const {
+  if (ld == 0) {
+    ld = cols;
+  }
+  if (_activation_type == SOFTMAX) {
+    apply_softmax (data, rows, cols, ld);
+    return;
+  }
+  // element wise: one pass over all the values, or one per padded row
+  int passes = ld == cols ? 1 : rows;
+  size_t count = ld == cols ? (size_t) rows * cols : cols;
+  for (int r = 0; r < passes; ++r) {
+    float *values = data + (size_t) r * ld;
+    switch (_activation_type) {
+      case RELU:
+        apply_relu (values, count);
+        break;
+      case SIGMOID:
+        apply_sigmoid (values, count);
+        break;
+      case TANH:
+        apply_tanh (values, count);
+        break;
+      case GELU:
+        apply_gelu (values, count);
+        break;
+      default:
+        break;
+    }
   }
-  return softmax (m);
 }
-
-
@@ -12,9 +12,15 @@
 enum ActivationType
 {
     RELU,
-    SOFTMAX
+    SOFTMAX,
+    SIGMOID,
+    TANH,
+    GELU
 };
 
+// number of ActivationType values (bundles store them as numbers)
+#define ACTIVATION_TYPE_COUNT 5
+
 // Insert Activation class here...
 class Activation{
 
@@ -22,22 +28,6 @@ class Activation{
 
   ActivationType _activation_type;
 
-  /**
- * if m[i]<0 we cheng it to 0 and else we do nothing
- * @param m matrix
- * @return new matrix
- */
-  Matrix relu (Matrix const &m) const;
-
-  /**
- * Returns a matrix according to the formula provided in the exercise
- * @param m matrix
- * @return new matrix
- */
-  Matrix softmax (Matrix const &m) const;
-
-
-
  public:
 
   /**
@@ -52,7 +42,7 @@ class Activation{
  * get type of activationType
  * @return activationType of obj
  */
-  ActivationType get_activation_type();
+  ActivationType get_activation_type() const;
 
   /**
  * Applies activation function on input
@@ -61,6 +51,24 @@ class Activation{
  */
   Matrix operator()(const Matrix &m) const ;
 
+  /**
+ * Applies activation function on a temporary input, reusing its elements
+ * @param m matrix
+ * @return the act function
+ */
+  Matrix operator()(Matrix &&m) const ;
+
+  /**
+ * Applies activation function in place, with the SIMD kernels of
+ * ActivationKernels.h
+ * @param data rows x cols values stored row by row, one vector per column
+ * @param rows length of every vector
+ * @param cols number of vectors
+ * @param ld floats between two stored rows, 0 for cols (the padding past
+ * cols is not touched)
+ */
+  void apply (float *data, int rows, int cols, int ld = 0) const;
+
 
 
 
@@ -0,0 +1,487 @@
+#include "ActivationKernels.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ACTIVATION_X86
+#include <immintrin.h>
+#endif
+
+#define ACTIVATION_LANES 8
+
+// exp: clamped range (e^88 < FLT_MAX, e^-87.3 ~ FLT_MIN), ln2 split in a
+// part exact in float and a rest, and the Cephes expf polynomial
+#define EXP_HI 88.0f
+#define EXP_LO (-87.33654f)
+#define LOG2E 1.44269504088896341f
+#define LN2_HI 0.693359375f
+#define LN2_LO (-2.12194440e-4f)
+#define EXP_P0 1.9875691500e-4f
+#define EXP_P1 1.3981999507e-3f
+#define EXP_P2 8.3334519073e-3f
+#define EXP_P3 4.1665795894e-2f
+#define EXP_P4 1.6666665459e-1f
+#define EXP_P5 5.0000001201e-1f
+
+// tanh: below TANH_SMALL the Cephes tanhf odd polynomial, which avoids the
+// cancellation of 1 - 2 / (e^2x + 1) near 0
+#define TANH_SMALL 0.625f
+#define TANH_P0 (-5.70498872745e-3f)
+#define TANH_P1 2.06390887954e-2f
+#define TANH_P2 (-5.37397155531e-2f)
+#define TANH_P3 1.33314422036e-1f
+#define TANH_P4 (-3.33332819422e-1f)
+
+// gelu: sqrt (2 / pi) and the cubic coefficient of the tanh approximation
+#define GELU_K 0.7978845608028654f
+#define GELU_C 0.044715f
+
+/**
+ * e^x, see ActivationKernels.h
+ * @param x exponent
+ * @return e^x
+ */
+float approx_exp (float x) {
+  // written so that NaN is clamped as well
+  x = x > EXP_LO ? x : EXP_LO;
+  x = x < EXP_HI ? x : EXP_HI;
+  float n = std::nearbyint (x * LOG2E);
+  float r = x - n * LN2_HI;
+  r = r - n * LN2_LO;
+  float p = EXP_P0;
+  p = p * r + EXP_P1;
+  p = p * r + EXP_P2;
+  p = p * r + EXP_P3;
+  p = p * r + EXP_P4;
+  p = p * r + EXP_P5;
+  float y = p * r * r + r + 1;
+  int32_t bits = ((int32_t) n + 127) << 23;
+  float scale;
+  std::memcpy (&scale, &bits, sizeof (scale));
+  return y * scale;
+}
+
+/**
+ * tanh, see apply_tanh
+ * @param x value
+ * @return tanh (x)
+ */
+static float approx_tanh (float x) {
+  float a = std::fabs (x);
+  if (a < TANH_SMALL) {
+    float z = x * x;
+    float p = TANH_P0;
+    p = p * z + TANH_P1;
+    p = p * z + TANH_P2;
+    p = p * z + TANH_P3;
+    p = p * z + TANH_P4;
+    return x + x * z * p;
+  }
+  float t = 1 - 2 / (approx_exp (2 * a) + 1);
+  return x < 0 ? -t : t;
+}
+
+/**
+ * softmax of one vector, max shifted
+ * @param x first value of the vector
+ * @param rows length of the vector
+ * @param stride distance between two values of the vector
+ */
+static void softmax_vector (float *x, int rows, int stride) {
+  float max = x[0];
+  for (int r = 1; r < rows; ++r) {
+    max = std::fmax (max, x[(size_t) r * stride]);
+  }
+  float sum = 0;
+  for (int r = 0; r < rows; ++r) {
+    float e = approx_exp (x[(size_t) r * stride] - max);
+    x[(size_t) r * stride] = e;
+    sum += e;
+  }
+  float scalar = 1 / sum;
+  for (int r = 0; r < rows; ++r) {
+    x[(size_t) r * stride] *= scalar;
+  }
+}
+
+/**
+ * x[i] = max (x[i], 0), portable loop
+ * @param x values
+ * @param count number of values
+ */
+static void relu_generic (float *x, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    x[i] = x[i] > 0 ? x[i] : 0;
+  }
+}
+
+/**
+ * softmax of every column, one column at a time, portable loop
+ * @param x values
+ * @param rows length of every vector
+ * @param cols number of vectors
+ * @param ld floats between two stored rows
+ */
+static void softmax_generic (float *x, int rows, int cols, int ld) {
+  for (int c = 0; c < cols; ++c) {
+    softmax_vector (x + c, rows, ld);
+  }
+}
+
+/**
+ * x[i] = 1 / (1 + e^-x[i]), portable loop
+ * @param x values
+ * @param count number of values
+ */
+static void sigmoid_generic (float *x, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    x[i] = 1 / (1 + approx_exp (-x[i]));
+  }
+}
+
+/**
+ * x[i] = tanh (x[i]), portable loop
+ * @param x values
+ * @param count number of values
+ */
+static void tanh_generic (float *x, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    x[i] = approx_tanh (x[i]);
+  }
+}
+
+/**
+ * GELU with the tanh approximation, portable loop
+ * @param x values
+ * @param count number of values
+ */
+static void gelu_generic (float *x, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    float v = x[i];
+    x[i] = 0.5f * v * (1 + approx_tanh (GELU_K * (v + GELU_C * v * v * v)));
+  }
+}
+
+#ifdef ACTIVATION_X86
+/**
+ * approx_exp of eight values
+ * @param x exponents
+ * @return e^x
+ */
+__attribute__ ((target ("avx2,fma")))
+static inline __m256 exp_avx2 (__m256 x) {
+  // max / min return the bound for NaN lanes
+  x = _mm256_min_ps (_mm256_max_ps (x, _mm256_set1_ps (EXP_LO)),
+                     _mm256_set1_ps (EXP_HI));
+  __m256 n = _mm256_round_ps (_mm256_mul_ps (x, _mm256_set1_ps (LOG2E)),
+                              _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256 r = _mm256_fnmadd_ps (n, _mm256_set1_ps (LN2_HI), x);
+  r = _mm256_fnmadd_ps (n, _mm256_set1_ps (LN2_LO), r);
+  __m256 p = _mm256_set1_ps (EXP_P0);
+  p = _mm256_fmadd_ps (p, r, _mm256_set1_ps (EXP_P1));
+  p = _mm256_fmadd_ps (p, r, _mm256_set1_ps (EXP_P2));
+  p = _mm256_fmadd_ps (p, r, _mm256_set1_ps (EXP_P3));
+  p = _mm256_fmadd_ps (p, r, _mm256_set1_ps (EXP_P4));
+  p = _mm256_fmadd_ps (p, r, _mm256_set1_ps (EXP_P5));
+  __m256 y = _mm256_add_ps (_mm256_fmadd_ps (p, _mm256_mul_ps (r, r), r),
+                            _mm256_set1_ps (1));
+  __m256i bits = _mm256_slli_epi32 (
+      _mm256_add_epi32 (_mm256_cvtps_epi32 (n), _mm256_set1_epi32 (127)), 23);
+  return _mm256_mul_ps (y, _mm256_castsi256_ps (bits));
+}
+
+/**
+ * approx_tanh of eight values, both branches blended by |x|
+ * @param x values
+ * @return tanh (x)
+ */
+__attribute__ ((target ("avx2,fma")))
+static inline __m256 tanh_avx2 (__m256 x) {
+  __m256 sign_bit = _mm256_set1_ps (-0.0f);
+  __m256 a = _mm256_andnot_ps (sign_bit, x);
+  __m256 z = _mm256_mul_ps (x, x);
+  __m256 p = _mm256_set1_ps (TANH_P0);
+  p = _mm256_fmadd_ps (p, z, _mm256_set1_ps (TANH_P1));
+  p = _mm256_fmadd_ps (p, z, _mm256_set1_ps (TANH_P2));
+  p = _mm256_fmadd_ps (p, z, _mm256_set1_ps (TANH_P3));
+  p = _mm256_fmadd_ps (p, z, _mm256_set1_ps (TANH_P4));
+  __m256 small = _mm256_fmadd_ps (_mm256_mul_ps (x, z), p, x);
+
+  __m256 one = _mm256_set1_ps (1);
+  __m256 e = exp_avx2 (_mm256_add_ps (a, a));
+  __m256 large = _mm256_sub_ps (
+      one, _mm256_div_ps (_mm256_set1_ps (2), _mm256_add_ps (e, one)));
+  large = _mm256_or_ps (large, _mm256_and_ps (sign_bit, x));
+
+  __m256 is_small = _mm256_cmp_ps (a, _mm256_set1_ps (TANH_SMALL), _CMP_LT_OQ);
+  return _mm256_blendv_ps (large, small, is_small);
+}
+
+/**
+ * largest of the eight lanes of a register
+ * @param v the register
+ * @return the maximum
+ */
+__attribute__ ((target ("avx2")))
+static inline float horizontal_max (__m256 v) {
+  __m128 max = _mm_max_ps (_mm256_castps256_ps128 (v),
+                           _mm256_extractf128_ps (v, 1));
+  max = _mm_max_ps (max, _mm_movehl_ps (max, max));
+  max = _mm_max_ss (max, _mm_movehdup_ps (max));
+  return _mm_cvtss_f32 (max);
+}
+
+/**
+ * sums the eight lanes of a register
+ * @param v the register
+ * @return the sum
+ */
+__attribute__ ((target ("avx2")))
+static inline float horizontal_sum (__m256 v) {
+  __m128 sum = _mm_add_ps (_mm256_castps256_ps128 (v),
+                           _mm256_extractf128_ps (v, 1));
+  sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+  sum = _mm_add_ss (sum, _mm_movehdup_ps (sum));
+  return _mm_cvtss_f32 (sum);
+}
+
+/**
+ * x[i] = max (x[i], 0), eight values at a time
+ * @param x values
+ * @param count number of values
+ */
+__attribute__ ((target ("avx2")))
+static void relu_avx2 (float *x, size_t count) {
+  __m256 zero = _mm256_setzero_ps ();
+  size_t i = 0;
+  for (; i + ACTIVATION_LANES <= count; i += ACTIVATION_LANES) {
+    _mm256_storeu_ps (x + i, _mm256_max_ps (_mm256_loadu_ps (x + i), zero));
+  }
+  relu_generic (x + i, count - i);
+}
+
+/**
+ * softmax of a single contiguous vector, the lanes run along it
+ * @param x values
+ * @param rows length of the vector
+ */
+__attribute__ ((target ("avx2,fma")))
+static void softmax_contiguous_avx2 (float *x, int rows) {
+  int full = rows - rows % ACTIVATION_LANES;
+  float max = x[0];
+  if (full > 0) {
+    __m256 lanes = _mm256_loadu_ps (x);
+    for (int r = ACTIVATION_LANES; r < full; r += ACTIVATION_LANES) {
+      lanes = _mm256_max_ps (lanes, _mm256_loadu_ps (x + r));
+    }
+    max = horizontal_max (lanes);
+  }
+  for (int r = full; r < rows; ++r) {
+    max = std::fmax (max, x[r]);
+  }
+
+  __m256 shift = _mm256_set1_ps (max);
+  __m256 lanes = _mm256_setzero_ps ();
+  for (int r = 0; r < full; r += ACTIVATION_LANES) {
+    __m256 e = exp_avx2 (_mm256_sub_ps (_mm256_loadu_ps (x + r), shift));
+    _mm256_storeu_ps (x + r, e);
+    lanes = _mm256_add_ps (lanes, e);
+  }
+  float sum = horizontal_sum (lanes);
+  for (int r = full; r < rows; ++r) {
+    x[r] = approx_exp (x[r] - max);
+    sum += x[r];
+  }
+
+  float scalar = 1 / sum;
+  __m256 scale = _mm256_set1_ps (scalar);
+  for (int r = 0; r < full; r += ACTIVATION_LANES) {
+    _mm256_storeu_ps (x + r, _mm256_mul_ps (_mm256_loadu_ps (x + r), scale));
+  }
+  for (int r = full; r < rows; ++r) {
+    x[r] *= scalar;
+  }
+}
+
+/**
+ * softmax of every column, the lanes run along eight columns at a time so
+ * every value is loaded by a full row access
+ * @param x values
+ * @param rows length of every vector
+ * @param cols number of vectors
+ * @param ld floats between two stored rows
+ */
+__attribute__ ((target ("avx2,fma")))
+static void softmax_avx2 (float *x, int rows, int cols, int ld) {
+  if (cols == 1 && ld == 1) {
+    softmax_contiguous_avx2 (x, rows);
+    return;
+  }
+  int c = 0;
+  for (; c + ACTIVATION_LANES <= cols; c += ACTIVATION_LANES) {
+    float *first = x + c;
+    __m256 max = _mm256_loadu_ps (first);
+    for (int r = 1; r < rows; ++r) {
+      max = _mm256_max_ps (max, _mm256_loadu_ps (first + (size_t) r * ld));
+    }
+    __m256 sum = _mm256_setzero_ps ();
+    for (int r = 0; r < rows; ++r) {
+      float *row = first + (size_t) r * ld;
+      __m256 e = exp_avx2 (_mm256_sub_ps (_mm256_loadu_ps (row), max));
+      _mm256_storeu_ps (row, e);
+      sum = _mm256_add_ps (sum, e);
+    }
+    __m256 scale = _mm256_div_ps (_mm256_set1_ps (1), sum);
+    for (int r = 0; r < rows; ++r) {
+      float *row = first + (size_t) r * ld;
+      _mm256_storeu_ps (row, _mm256_mul_ps (_mm256_loadu_ps (row), scale));
+    }
+  }
+  for (; c < cols; ++c) {
+    softmax_vector (x + c, rows, ld);
+  }
+}
+
+/**
+ * x[i] = 1 / (1 + e^-x[i]), eight values at a time
+ * @param x values
+ * @param count number of values
+ */
+__attribute__ ((target ("avx2,fma")))
+static void sigmoid_avx2 (float *x, size_t count) {
+  __m256 one = _mm256_set1_ps (1);
+  __m256 sign_bit = _mm256_set1_ps (-0.0f);
+  size_t i = 0;
+  for (; i + ACTIVATION_LANES <= count; i += ACTIVATION_LANES) {
+    __m256 e = exp_avx2 (_mm256_xor_ps (_mm256_loadu_ps (x + i), sign_bit));
+    _mm256_storeu_ps (x + i, _mm256_div_ps (one, _mm256_add_ps (one, e)));
+  }
+  sigmoid_generic (x + i, count - i);
+}
+
+/**
+ * x[i] = tanh (x[i]), eight values at a time
+ * @param x values
+ * @param count number of values
+ */
+__attribute__ ((target ("avx2,fma")))
+static void tanh_avx2_kernel (float *x, size_t count) {
+  size_t i = 0;
+  for (; i + ACTIVATION_LANES <= count; i += ACTIVATION_LANES) {
+    _mm256_storeu_ps (x + i, tanh_avx2 (_mm256_loadu_ps (x + i)));
+  }
+  tanh_generic (x + i, count - i);
+}
+
+/**
+ * GELU with the tanh approximation, eight values at a time
+ * @param x values
+ * @param count number of values
+ */
+__attribute__ ((target ("avx2,fma")))
+static void gelu_avx2 (float *x, size_t count) {
+  __m256 half = _mm256_set1_ps (0.5f);
+  __m256 one = _mm256_set1_ps (1);
+  size_t i = 0;
+  for (; i + ACTIVATION_LANES <= count; i += ACTIVATION_LANES) {
+    __m256 v = _mm256_loadu_ps (x + i);
+    __m256 cube = _mm256_mul_ps (_mm256_mul_ps (v, v), v);
+    __m256 inner = _mm256_mul_ps (
+        _mm256_set1_ps (GELU_K),
+        _mm256_fmadd_ps (_mm256_set1_ps (GELU_C), cube, v));
+    __m256 t = _mm256_add_ps (one, tanh_avx2 (inner));
+    _mm256_storeu_ps (x + i, _mm256_mul_ps (_mm256_mul_ps (half, v), t));
+  }
+  gelu_generic (x + i, count - i);
+}
+#endif
+
+/**
+ * @struct activation_kernels
+ * @brief The kernels the cpu runs, one per activation.
+ */
+typedef struct activation_kernels {
+  void (*relu) (float *, size_t);
+  void (*softmax) (float *, int, int, int);
+  void (*sigmoid) (float *, size_t);
+  void (*tanh) (float *, size_t);
+  void (*gelu) (float *, size_t);
+} activation_kernels;
+
+/**
+ * Picks the fastest kernels the cpu can run.
+ * @return the kernels
+ */
+static activation_kernels select_kernels () {
+#ifdef ACTIVATION_X86
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma")) {
+    return activation_kernels {relu_avx2, softmax_avx2, sigmoid_avx2,
+                               tanh_avx2_kernel, gelu_avx2};
+  }
+#endif
+  return activation_kernels {relu_generic, softmax_generic, sigmoid_generic,
+                             tanh_generic, gelu_generic};
+}
+
+/**
+ *
+ * @return the kernels of the cpu, selected once
+ */
+static const activation_kernels &kernels () {
+  static const activation_kernels selected = select_kernels ();
+  return selected;
+}
+
+/**
+ * x[i] = max (x[i], 0)
+ * @param x values
+ * @param count number of values
+ */
+void apply_relu (float *x, size_t count) {
+  kernels ().relu (x, count);
+}
+
+/**
+ * Softmax of every column of a rows x cols matrix stored row by row (one
+ * vector per column). The column maximum is subtracted before the
+ * exponentials, so large logits can not overflow.
+ * @param x values
+ * @param rows length of every vector
+ * @param cols number of vectors
+ * @param ld floats between two stored rows (at least cols), the padding
+ * past cols is not touched
+ */
+void apply_softmax (float *x, int rows, int cols, int ld) {
+  kernels ().softmax (x, rows, cols, ld);
+}
+
+/**
+ * x[i] = 1 / (1 + e^-x[i])
+ * @param x values
+ * @param count number of values
+ */
+void apply_sigmoid (float *x, size_t count) {
+  kernels ().sigmoid (x, count);
+}
+
+/**
+ * x[i] = tanh (x[i]), an odd polynomial near 0 and 1 - 2 / (e^2x + 1)
+ * elsewhere, at most 1.33 ULP from a double precision tanh
+ * @param x values
+ * @param count number of values
+ */
+void apply_tanh (float *x, size_t count) {
+  kernels ().tanh (x, count);
+}
+
+/**
+ * GELU with the tanh approximation:
+ * x[i] = x / 2 * (1 + tanh (sqrt (2 / pi) * (x + 0.044715 * x^3)))
+ * @param x values
+ * @param count number of values
+ */
+void apply_gelu (float *x, size_t count) {
+  kernels ().gelu (x, count);
+}
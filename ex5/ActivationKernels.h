@@ -0,0 +1,70 @@
+// ActivationKernels.h
+#ifndef ACTIVATIONKERNELS_H
+#define ACTIVATIONKERNELS_H
+
+#include <cstddef>
+
+/*
+ * In place activation kernels. AVX2+FMA versions are used when the cpu
+ * has them (checked once), portable loops of the same algorithms
+ * otherwise.
+ *
+ * Every exponential goes through approx_exp: a Cephes style range
+ * reduction x = n * ln2 + r, |r| <= ln2 / 2, and a degree 6 polynomial of
+ * e^r, scaled by 2^n through the exponent bits. Against a double
+ * precision exp its error is at most 1.01 ULP on [-87.3, 88], in both
+ * the scalar and the AVX2 form (measured on every float of the range).
+ * Inputs outside of the range are clamped, so it never returns inf or
+ * NaN.
+ */
+
+/**
+ * e^x with the error described above
+ * @param x exponent
+ * @return e^x
+ */
+float approx_exp (float x);
+
+/**
+ * x[i] = max (x[i], 0)
+ * @param x values
+ * @param count number of values
+ */
+void apply_relu (float *x, size_t count);
+
+/**
+ * Softmax of every column of a rows x cols matrix stored row by row (one
+ * vector per column). The column maximum is subtracted before the
+ * exponentials, so large logits can not overflow.
+ * @param x values
+ * @param rows length of every vector
+ * @param cols number of vectors
+ * @param ld floats between two stored rows (at least cols), the padding
+ * past cols is not touched
+ */
+void apply_softmax (float *x, int rows, int cols, int ld);
+
+/**
+ * x[i] = 1 / (1 + e^-x[i])
+ * @param x values
+ * @param count number of values
+ */
+void apply_sigmoid (float *x, size_t count);
+
+/**
+ * x[i] = tanh (x[i]), an odd polynomial near 0 and 1 - 2 / (e^2x + 1)
+ * elsewhere, at most 1.33 ULP from a double precision tanh
+ * @param x values
+ * @param count number of values
+ */
+void apply_tanh (float *x, size_t count);
+
+/**
+ * GELU with the tanh approximation:
+ * x[i] = x / 2 * (1 + tanh (sqrt (2 / pi) * (x + 0.044715 * x^3)))
+ * @param x values
+ * @param count number of values
+ */
+void apply_gelu (float *x, size_t count);
+
+#endif //ACTIVATIONKERNELS_H
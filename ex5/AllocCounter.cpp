@@ -0,0 +1,128 @@
+#include "AllocCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(MLP_COUNT_ALLOCS)
+
+static std::atomic<unsigned long> allocs (0), frees (0), bytes (0);
+
+/**
+ * counts and serves an allocation
+ * @param size bytes to allocate
+ * @return the memory, nullptr on failure
+ */
+static void *counted_alloc (size_t size) {
+  allocs.fetch_add (1, std::memory_order_relaxed);
+  bytes.fetch_add (size, std::memory_order_relaxed);
+  return std::malloc (size != 0 ? size : 1);
+}
+
+/**
+ * counts and releases an allocation
+ * @param p the memory, may be nullptr
+ */
+static void counted_free (void *p) {
+  if (p != nullptr) {
+    frees.fetch_add (1, std::memory_order_relaxed);
+    std::free (p);
+  }
+}
+
+void *operator new (size_t size) {
+  void *p = counted_alloc (size);
+  if (p == nullptr) {
+    throw std::bad_alloc ();
+  }
+  return p;
+}
+
+void *operator new[] (size_t size) {
+  return operator new (size);
+}
+
+void *operator new (size_t size, const std::nothrow_t &) noexcept {
+  return counted_alloc (size);
+}
+
+void *operator new[] (size_t size, const std::nothrow_t &) noexcept {
+  return counted_alloc (size);
+}
+
+void operator delete (void *p) noexcept {
+  counted_free (p);
+}
+
+void operator delete[] (void *p) noexcept {
+  counted_free (p);
+}
+
+void operator delete (void *p, size_t) noexcept {
+  counted_free (p);
+}
+
+void operator delete[] (void *p, size_t) noexcept {
+  counted_free (p);
+}
+
+void operator delete (void *p, const std::nothrow_t &) noexcept {
+  counted_free (p);
+}
+
+void operator delete[] (void *p, const std::nothrow_t &) noexcept {
+  counted_free (p);
+}
+
+/**
+ *
+ * @return true, allocations are counted
+ */
+bool alloc_counting () {
+  return true;
+}
+
+/**
+ *
+ * @return heap activity of the whole process since it started
+ */
+alloc_stats alloc_count () {
+  alloc_stats stats = {allocs.load (std::memory_order_relaxed),
+                       frees.load (std::memory_order_relaxed),
+                       bytes.load (std::memory_order_relaxed)};
+  return stats;
+}
+
+#else
+
+/**
+ *
+ * @return false, allocations are not counted in this build
+ */
+bool alloc_counting () {
+  return false;
+}
+
+/**
+ *
+ * @return zero counts, allocations are not counted in this build
+ */
+alloc_stats alloc_count () {
+  alloc_stats stats = {0, 0, 0};
+  return stats;
+}
+
+#endif
+
+/**
+ * heap activity between two counts
+ * @param after the later count
+ * @param before the earlier count
+ * @return after - before
+ */
+alloc_stats alloc_diff (const alloc_stats &after, const alloc_stats &before) {
+  alloc_stats stats = {after.allocs - before.allocs,
+                       after.frees - before.frees,
+                       after.bytes - before.bytes};
+  return stats;
+}
@@ -0,0 +1,39 @@
+// AllocCounter.h
+#ifndef ALLOCCOUNTER_H
+#define ALLOCCOUNTER_H
+
+/**
+ * @struct alloc_stats
+ * @brief Heap activity counted by the replaced operator new / delete.
+ * @var allocs - number of calls to operator new (all forms)
+ * @var frees - number of calls to operator delete (all forms, non null)
+ * @var bytes - number of bytes asked from operator new
+ */
+typedef struct alloc_stats {
+  unsigned long allocs;
+  unsigned long frees;
+  unsigned long bytes;
+} alloc_stats;
+
+/**
+ *
+ * @return true if the program was built with MLP_COUNT_ALLOCS, otherwise
+ *         nothing is counted and alloc_count () stays zero
+ */
+bool alloc_counting ();
+
+/**
+ *
+ * @return heap activity of the whole process since it started
+ */
+alloc_stats alloc_count ();
+
+/**
+ * heap activity between two counts
+ * @param after the later count
+ * @param before the earlier count
+ * @return after - before
+ */
+alloc_stats alloc_diff (const alloc_stats &after, const alloc_stats &before);
+
+#endif //ALLOCCOUNTER_H
@@ -0,0 +1,86 @@
+#include "BatchEngine.h"
+
+#include <algorithm>
+
+/**
+ * constructor of class, starts the workers
+ * @param mlp network to run, its weights must outlive the engine
+ * @param threads number of workers, 0 for one per hardware thread
+ * @param pin true to pin worker i to cpu i
+ * @param chunk largest number of images in one chunk
+ */
+BatchEngine::BatchEngine (const MlpNetwork &mlp, int threads, bool pin,
+                          int chunk)
+    : _pool (threads, pin), _chunk (std::max (1, chunk)) {
+  // copies share the weights, only the scratch buffers are per worker
+  _networks.reserve (_pool.size ());
+  for (int i = 0; i < _pool.size (); ++i) {
+    _networks.push_back (mlp);
+  }
+}
+
+/**
+ *
+ * @return number of workers
+ */
+int BatchEngine::threads () const {
+  return _pool.size ();
+}
+
+/**
+ * size of the chunks of a set, small sets are spread over every worker
+ * @param count number of images in the set
+ * @return images per chunk
+ */
+int BatchEngine::chunk_size (int count) const {
+  int per_worker = (count + threads () - 1) / threads ();
+  return std::max (1, std::min (_chunk, per_worker));
+}
+
+/**
+ * Classifies a set of images in parallel
+ * @param imgs array of images (each one 28x28 or already vectorized)
+ * @param count number of images in the array
+ * @return digit struct of every image, in the order of the array
+ */
+std::vector<digit> BatchEngine::classify (const Matrix *imgs, int count) {
+  std::vector<digit> digits (std::max (count, 0));
+  _pool.parallel_for (count, chunk_size (count),
+                      [&] (int worker, int begin, int end) {
+                        std::vector<digit> chunk = _networks[worker]
+                            .classify_batch (imgs + begin, end - begin);
+                        std::copy (chunk.begin (), chunk.end (),
+                                   digits.begin () + begin);
+                      });
+  return digits;
+}
+
+/**
+ * Classifies a set of images in parallel
+ * @param imgs matrix with one flattened image per row (N x input_size)
+ * @return digit struct of every image, in the order of the rows
+ */
+std::vector<digit> BatchEngine::classify (const Matrix &imgs) {
+  std::vector<digit> digits (imgs.get_rows ());
+  classify (imgs, digits.data ());
+  return digits;
+}
+
+/**
+ * Classifies a set of images in parallel, allocates nothing once every
+ * worker has seen a full chunk
+ * @param imgs matrix with one flattened image per row (N x input_size)
+ * @param digits receives the digit struct of every row
+ */
+void BatchEngine::classify (const Matrix &imgs, digit *digits) {
+  int count = imgs.get_rows ();
+  MatrixView all (imgs);
+  _pool.parallel_for (count, chunk_size (count),
+                      [&] (int worker, int begin, int end) {
+                        // the rows of the chunk, not copied
+                        MatrixView rows = all.block (begin, 0, end - begin,
+                                                     all.get_cols ());
+                        _networks[worker].classify_batch (rows,
+                                                          digits + begin);
+                      });
+}
@@ -0,0 +1,75 @@
+// BatchEngine.h
+#ifndef BATCHENGINE_H
+#define BATCHENGINE_H
+
+#include "MlpNetwork.h"
+#include "ThreadPool.h"
+
+#include <vector>
+
+// largest number of images one worker classifies in a single call
+#define ENGINE_CHUNK_SIZE 256
+
+/**
+ * Classifies large sets of images on a pool of worker threads. Every
+ * worker has its own copy of the network (its own scratch buffers) while
+ * the weights stay shared and read-only, and the set is split into chunks
+ * that the workers classify as batches. Results keep the input order.
+ */
+class BatchEngine {
+
+ private:
+  std::vector<MlpNetwork> _networks;
+  ThreadPool _pool;
+  int _chunk;
+
+  /**
+   * size of the chunks of a set
+   * @param count number of images in the set
+   * @return images per chunk
+   */
+  int chunk_size (int count) const;
+
+ public:
+
+  /**
+   * constructor of class, starts the workers
+   * @param mlp network to run, its weights must outlive the engine
+   * @param threads number of workers, 0 for one per hardware thread
+   * @param pin true to pin worker i to cpu i
+   * @param chunk largest number of images in one chunk
+   */
+  explicit BatchEngine (const MlpNetwork &mlp, int threads = 0,
+                        bool pin = false, int chunk = ENGINE_CHUNK_SIZE);
+
+  /**
+   *
+   * @return number of workers
+   */
+  int threads () const;
+
+  /**
+   * Classifies a set of images in parallel
+   * @param imgs array of images (each one 28x28 or already vectorized)
+   * @param count number of images in the array
+   * @return digit struct of every image, in the order of the array
+   */
+  std::vector<digit> classify (const Matrix *imgs, int count);
+
+  /**
+   * Classifies a set of images in parallel
+   * @param imgs matrix with one flattened image per row (N x input_size)
+   * @return digit struct of every image, in the order of the rows
+   */
+  std::vector<digit> classify (const Matrix &imgs);
+
+  /**
+   * Classifies a set of images in parallel, allocates nothing once every
+   * worker has seen a full chunk
+   * @param imgs matrix with one flattened image per row (N x input_size)
+   * @param digits receives the digit struct of every row
+   */
+  void classify (const Matrix &imgs, digit *digits);
+};
+
+#endif //BATCHENGINE_H
@@ -1,12 +1,187 @@
 #include "Dense.h"
+#include "Gemm.h"
+
+#include <vector>
 
 
 /**
- *
- * @param m - matrix
+ * The weight product, the bias and relu run as one fused kernel: the bias
+ * is added (and relu applied) while each output tile is stored, so the
+ * output is written exactly once. The other activations are one extra
+ * SIMD pass over the finished output (softmax needs the whole column).
+ * @param m - matrix or view, a single input vector or a batch with one
+ * input per column
  * @return Applies the layer on input and returns output matrix Layers operate
  */
-Matrix Dense::operator() (Matrix const &m){
-  return _activation((_w * m) + _bias);
+Matrix Dense::operator() (MatrixView const &m){
+  if (_cols != m.get_rows ()
+      || _bias.get_rows () * _bias.get_cols () != _rows
+      || !_bias.is_contiguous ()) {
+    std::cerr << "Error: rows of the new matrix must be equal to"
+                 " the cols of the old one" << std::endl;
+    exit (EXIT_FAILURE);
+  }
+  if (!m.is_contiguous ()) {
+    // the kernels take inputs stored row by row without padding
+    return (*this) (Matrix (m));
+  }
+  Matrix output (_rows, m.get_cols ());
+  forward (m.data (), m.get_cols (), output.data ());
+  return output;
+}
+
+/**
+ * Applies the layer without allocating anything
+ * @param in - cols x n inputs, stored row by row (one input per column)
+ * @param n - number of inputs
+ * @param out - receives the rows x n outputs, stored row by row
+ */
+void Dense::forward (const float *in, int n, float *out) const {
+  bool relu = _activation.get_activation_type () == RELU;
+  gemm_epilogue epilogue = {_bias.data (), relu};
+  if (_quantized) {
+    _quantized->multiply (in, n, out, epilogue);
+  }
+  else if (_half) {
+    _half->multiply (in, n, out, epilogue);
+  }
+  else if (_sparse) {
+    _sparse->multiply (in, n, out, epilogue);
+  }
+  else if (n > 1 || !_sparse_input
+           || !forward_sparse_input (in, out, epilogue)) {
+    _packed->multiply (in, n, out, epilogue);
+  }
+  if (!relu) {
+    _activation.apply (out, _rows, n);
+  }
+}
+
+/**
+ * Applies the layer on a single input through the columns of its non zero
+ * elements, if the input is sparse enough
+ * @param in - the input vector
+ * @param out - receives the outputs
+ * @param epilogue - bias / relu of the outputs
+ * @return false (and nothing done) if the input is too dense
+ */
+bool Dense::forward_sparse_input (const float *in, float *out,
+                                  gemm_epilogue epilogue) const {
+  // indexes of the non zero inputs, reused by the layers of the thread
+  static thread_local std::vector<int32_t> nonzeros;
+  nonzeros.resize (_cols);
+  int count = 0;
+  for (int c = 0; c < _cols; ++c) {
+    if (in[c] != 0) {
+      nonzeros[count++] = c;
+    }
+  }
+  if (count > INPUT_SPARSE_MAX_DENSITY * _cols) {
+    return false;
+  }
+  _packed->multiply_sparse_input (in, nonzeros.data (), count, out,
+                                  epilogue);
+  return true;
+}
+
+/**
+ * Exits (code == 1) if the layer only has 16 bit or sparse weights
+ * @return Returns the weights of this layer forbids modification
+ */
+const MatrixView &Dense::get_weights () const {
+  if (_w.data () == nullptr) {
+    std::cerr << "Error: the layer has no float weights" << std::endl;
+    exit (EXIT_FAILURE);
+  }
+  return _w;
+}
+
+/**
+ * Chooses the weights storage of the products
+ * @param precision - storage to use
+ */
+void Dense::set_precision (WeightPrecision precision) {
+  if (precision == get_precision ()) {
+    return;
+  }
+  const MatrixView &w = get_weights ();
+  _quantized.reset ();
+  _half.reset ();
+  _sparse.reset ();
+  if (precision == PRECISION_INT8) {
+    _quantized = std::make_shared<const QuantizedMatrix> (w);
+  }
+  else if (precision == PRECISION_FP16) {
+    _half = std::make_shared<const HalfMatrix> (w, HALF_FP16);
+  }
+  else if (precision == PRECISION_BF16) {
+    _half = std::make_shared<const HalfMatrix> (w, HALF_BF16);
+  }
+  update_packed ();
 }
 
+/**
+ *
+ * @return the weights storage the products use
+ */
+WeightPrecision Dense::get_precision () const {
+  if (_quantized) {
+    return PRECISION_INT8;
+  }
+  if (_half) {
+    return _half->get_format () == HALF_FP16 ? PRECISION_FP16
+                                             : PRECISION_BF16;
+  }
+  return PRECISION_F32;
+}
+
+
+/**
+ * Runs the products on a sparse copy of the float weights
+ * @param threshold - largest absolute value to drop
+ * @return true if the layer is now sparse
+ */
+bool Dense::set_sparse (float threshold) {
+  const MatrixView &w = get_weights ();
+  _sparse.reset ();
+  if (threshold < 0) {
+    update_packed ();
+    return false;
+  }
+  std::shared_ptr<const SparseMatrix> sparse =
+      std::make_shared<const SparseMatrix> (w, threshold);
+  if (sparse->density () > SPARSE_MAX_DENSITY) {
+    update_packed ();
+    return false;
+  }
+  _quantized.reset ();
+  _half.reset ();
+  _sparse = std::move (sparse);
+  update_packed ();
+  return true;
+}
+
+/**
+ * Lets sparse single inputs skip the weight columns of their zeros
+ * @param enable - true to skip the zeros, false to multiply them
+ * @return true if enabled, false if the layer has no float weights
+ */
+bool Dense::set_sparse_input (bool enable) {
+  _sparse_input = enable && _w.data () != nullptr;
+  return _sparse_input;
+}
+
+/**
+ * Packs the float weights (or takes the stored panels) if the products
+ * run on them (no reduced precision or sparse copy), otherwise frees
+ * the packed copy
+ */
+void Dense::update_packed () {
+  if (_quantized || _half || _sparse || _w.data () == nullptr) {
+    _packed.reset ();
+  }
+  else if (!_packed) {
+    _packed = _stored_packed ? _stored_packed
+                             : std::make_shared<const PackedMatrix> (_w);
+  }
+}
@@ -2,45 +2,168 @@
 #define C___PROJECT_DENSE_H
 
 #include "Activation.h"
+#include "HalfMatrix.h"
 #include "Matrix.h"
+#include "MatrixView.h"
+#include "PackedMatrix.h"
+#include "Quantize.h"
+#include "SparseMatrix.h"
+
+#include <memory>
+
+/**
+ * @enum WeightPrecision
+ * @brief Storage the products of a layer read its weights from.
+ */
+enum WeightPrecision
+{
+    PRECISION_F32,
+    PRECISION_INT8,
+    PRECISION_FP16,
+    PRECISION_BF16
+};
+
+// densest single input that runs the sparse input product (a fraction
+// of non zero elements), denser inputs run the dense product
+#define INPUT_SPARSE_MAX_DENSITY 0.5f
 
 // implement class Dense here...
 
 /**
  * The class represents a layer ,and will be used to
  * define and run the various layer operations on the network.
+ * The layer does not own its parameters, it only refers to them, so the
+ * weights and bias must outlive the layer. The float products read the
+ * weights packed for the kernels (see PackedMatrix): panels stored in a
+ * bundle, or a copy packed once, shared by the copies of the layer and
+ * freed while the products run on a reduced precision or sparse copy.
+ * The weights are float, or only 16 bit or sparse (e.g. from a bundle),
+ * and the products may read them from a reduced precision or a sparse
+ * copy.
  */
 class Dense {
  private:
-  const Matrix _w;
-  const Matrix _bias;
+  // views of the parameters, _w is empty when the layer only has 16 bit
+  // or sparse weights
+  MatrixView _w;
+  MatrixView _bias;
   Activation _activation;
+  int _rows, _cols;
+  // reduced precision copies, shared by the copies of the layer
+  std::shared_ptr<const QuantizedMatrix> _quantized;
+  std::shared_ptr<const HalfMatrix> _half;
+  std::shared_ptr<const SparseMatrix> _sparse;
+  // the float weights in the layout of the kernels, only kept while the
+  // products run on the float weights
+  std::shared_ptr<const PackedMatrix> _packed;
+  // panels stored with the weights (e.g. mapped from a bundle), null if
+  // the layer packs its own copy
+  std::shared_ptr<const PackedMatrix> _stored_packed;
+  bool _sparse_input;
+
+  /**
+   * Applies the layer on a single input through the columns of the non
+   * zero input elements, if the input is sparse enough
+   * @param in - the input vector
+   * @param out - receives the outputs
+   * @param epilogue - bias / relu of the outputs
+   * @return false (and nothing done) if the input is too dense
+   */
+  bool forward_sparse_input (const float *in, float *out,
+                             gemm_epilogue epilogue) const;
+
+  /**
+   * Packs the float weights (or takes the stored panels) if the products
+   * run on them (no reduced precision or sparse copy), otherwise frees
+   * the packed copy
+   */
+  void update_packed ();
 
  public:
 
   /**
- * constructor of class
- * @param w - matrix
- * @param bias - vector
+ * constructor of class, keeps views of the parameters and packs a copy of
+ * the weights in the layout of the product kernels
+ * @param w - matrix or view (e.g. of mapped weights)
+ * @param bias - vector or view
  * @param activationType - the type of activation function.
  */
-  Dense (const Matrix &w, const Matrix &bias, ActivationType activationType) :
-      _w (w), _bias (bias), _activation (activationType) {
+  Dense (const MatrixView &w, const MatrixView &bias,
+         ActivationType activationType) :
+      _w (w), _bias (bias), _activation (activationType),
+      _rows (w.get_rows ()), _cols (w.get_cols ()),
+      _packed (std::make_shared<const PackedMatrix> (w)),
+      _sparse_input (false) {
   }
 
   /**
- *
+ * constructor of class with the weights already packed (no copy), e.g.
+ * the panels of a bundle
+ * @param w - matrix or view (e.g. of mapped weights)
+ * @param packed - the same weights packed by gemm_pack
+ * @param bias - vector or view
+ * @param activationType - the type of activation function.
+ */
+  Dense (const MatrixView &w, std::shared_ptr<const PackedMatrix> packed,
+         const MatrixView &bias, ActivationType activationType) :
+      _w (w), _bias (bias), _activation (activationType),
+      _rows (w.get_rows ()), _cols (w.get_cols ()), _packed (packed),
+      _stored_packed (std::move (packed)), _sparse_input (false) {
+  }
+
+  /**
+ * constructor of a layer that only has 16 bit weights (no copy)
+ * @param w - 16 bit weights
+ * @param bias - vector or view
+ * @param activationType - the type of activation function.
+ */
+  Dense (std::shared_ptr<const HalfMatrix> w, const MatrixView &bias,
+         ActivationType activationType) :
+      _bias (bias), _activation (activationType),
+      _rows (w->get_rows ()), _cols (w->get_cols ()), _half (std::move (w)),
+      _sparse_input (false) {
+  }
+
+  /**
+ * constructor of a layer that only has sparse weights (no copy)
+ * @param w - sparse weights
+ * @param bias - vector or view
+ * @param activationType - the type of activation function.
+ */
+  Dense (std::shared_ptr<const SparseMatrix> w, const MatrixView &bias,
+         ActivationType activationType) :
+      _bias (bias), _activation (activationType),
+      _rows (w->get_rows ()), _cols (w->get_cols ()),
+      _sparse (std::move (w)), _sparse_input (false) {
+  }
+
+  /**
+ * Exits (code == 1) if the layer only has 16 bit or sparse weights
  * @return Returns the weights of this layer forbids modification
  */
-  const Matrix &get_weights () {
-    return _w;
+  const MatrixView &get_weights () const;
+
+  /**
+ *
+ * @return number of outputs of the layer (rows of the weights)
+ */
+  int get_rows () const {
+    return _rows;
+  }
+
+  /**
+ *
+ * @return number of inputs of the layer (cols of the weights)
+ */
+  int get_cols () const {
+    return _cols;
   }
 
   /**
  *
  * @return Returns the bias of this layer forbids modification
  */
-  const Matrix &get_bias () {
+  const MatrixView &get_bias () const {
     return _bias;
   }
 
@@ -48,17 +171,75 @@ class Dense {
  *
  * @return activation func of obj
  */
-  Activation get_activation () {
+  Activation get_activation () const {
     return _activation;
   }
 
   /**
    *
-   * @param m - matrix.
+   * @param m - matrix or view, a single input vector or a batch with one
+   * input per column (the bias is added to every column). Views that are
+   * not contiguous (e.g. transposed) are copied once for the kernels.
    * @return Applies the layer on input and returns output matrix Layers
    * operate
    */
-  Matrix operator() (Matrix const &m);
+  Matrix operator() (MatrixView const &m);
+
+  /**
+   * Applies the layer without allocating anything
+   * @param in - cols x n inputs, stored row by row (one input per column)
+   * @param n - number of inputs
+   * @param out - receives the rows x n outputs, stored row by row
+   */
+  void forward (const float *in, int n, float *out) const;
+
+  /**
+   * Chooses the weights storage of the products. PRECISION_INT8 quantizes
+   * the weights once (per output row scales) and runs int8 products,
+   * PRECISION_FP16 / PRECISION_BF16 convert them once to 16 bit floats,
+   * PRECISION_F32 goes back to the float weights (sparse ones stay
+   * sparse). A layer with only 16 bit or sparse weights can not change
+   * precision, exits (code == 1) if asked to.
+   * @param precision - storage to use
+   */
+  void set_precision (WeightPrecision precision);
+
+  /**
+   * Runs the products on a sparse (CSR) copy of the float weights, without
+   * the weights whose absolute value is at most threshold. The layer
+   * stays dense when more than SPARSE_MAX_DENSITY of its weights are
+   * left. A negative threshold goes back to the dense float weights.
+   * The products run in float precision either way. Exits (code == 1) if
+   * the layer has no float weights.
+   * @param threshold - largest absolute value to drop
+   * @return true if the layer is now sparse
+   */
+  bool set_sparse (float threshold);
+
+  /**
+   * Lets single inputs (n == 1) with at most INPUT_SPARSE_MAX_DENSITY non
+   * zero elements skip the weight columns of their zeros, e.g. the
+   * background pixels of an image. Costs a scan of every input, so only
+   * worth it for a layer that sees raw inputs.
+   * Only used while the products run on the dense float weights.
+   * @param enable - true to skip the zeros, false to multiply them
+   * @return true if enabled, false if the layer has no float weights
+   */
+  bool set_sparse_input (bool enable);
+
+  /**
+   *
+   * @return true if the products read sparse weights
+   */
+  bool is_sparse () const {
+    return _sparse != nullptr;
+  }
+
+  /**
+   *
+   * @return the weights storage the products use
+   */
+  WeightPrecision get_precision () const;
 
 };
 
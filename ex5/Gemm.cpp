@@ -0,0 +1,892 @@
+#include "Gemm.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEMM_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * Copies an mc x kc block of A into MR-row panels: for every k the MR
+ * elements of the panel column are contiguous, rows past mc are zero.
+ * A transposed A (rsa 1) is packed the same way, so the kernels never
+ * see the transposition.
+ * @param mc rows of the block
+ * @param kc cols of the block
+ * @param a first element of the block
+ * @param rsa row stride of A
+ * @param csa col stride of A
+ * @param packed destination, ceil(mc / MR) * MR * kc floats
+ */
+static void pack_a (int mc, int kc, const float *a, int rsa, int csa,
+                    float *packed) {
+  for (int p = 0; p < mc; p += GEMM_MR) {
+    int rows = std::min (GEMM_MR, mc - p);
+    for (int k = 0; k < kc; ++k) {
+      for (int r = 0; r < rows; ++r) {
+        packed[r] = a[(size_t) (p + r) * rsa + (size_t) k * csa];
+      }
+      for (int r = rows; r < GEMM_MR; ++r) {
+        packed[r] = 0;
+      }
+      packed += GEMM_MR;
+    }
+  }
+}
+
+/**
+ * Copies a kc x nc block of B into NR-col panels: for every k the NR
+ * elements of the panel row are contiguous, cols past nc are zero.
+ * @param kc rows of the block
+ * @param nc cols of the block
+ * @param b first element of the block
+ * @param rsb row stride of B
+ * @param csb col stride of B
+ * @param packed destination, ceil(nc / NR) * NR * kc floats
+ */
+static void pack_b (int kc, int nc, const float *b, int rsb, int csb,
+                    float *packed) {
+  for (int q = 0; q < nc; q += GEMM_NR) {
+    int cols = std::min (GEMM_NR, nc - q);
+    for (int k = 0; k < kc; ++k) {
+      for (int j = 0; j < cols; ++j) {
+        packed[j] = b[(size_t) k * rsb + (size_t) (q + j) * csb];
+      }
+      for (int j = cols; j < GEMM_NR; ++j) {
+        packed[j] = 0;
+      }
+      packed += GEMM_NR;
+    }
+  }
+}
+
+/**
+ * Writes an MR x NR tile, held column by column, into the mr x nr corner
+ * of C, applying the epilogue on the way.
+ * @param tile the tile, tile[j * MR + r] is element (r, j)
+ * @param c first element of the tile in C
+ * @param ldc row stride of C
+ * @param mr valid rows
+ * @param nr valid cols
+ * @param accumulate add to C instead of overwriting it
+ * @param epilogue bias of the first row of the tile and relu flag, only set
+ * on the last k block
+ */
+static void store_tile (const float *tile, float *c, int ldc, int mr, int nr,
+                        bool accumulate, gemm_epilogue epilogue) {
+  for (int r = 0; r < mr; ++r) {
+    float bias = epilogue.bias == nullptr ? 0 : epilogue.bias[r];
+    for (int j = 0; j < nr; ++j) {
+      float value = tile[j * GEMM_MR + r] + bias;
+      if (accumulate) {
+        value += c[r * ldc + j];
+      }
+      if (epilogue.relu && value < 0) {
+        value = 0;
+      }
+      c[r * ldc + j] = value;
+    }
+  }
+}
+
+/**
+ * Portable micro-kernel, C tile (+)= A panel * B panel.
+ * @param kc length of the panels
+ * @param a packed A panel
+ * @param b packed B panel
+ * @param c first element of the tile in C
+ * @param ldc row stride of C
+ * @param mr valid rows
+ * @param nr valid cols
+ * @param accumulate add to C instead of overwriting it
+ * @param epilogue applied while storing the tile
+ */
+static void kernel_generic (int kc, const float *a, const float *b, float *c,
+                            int ldc, int mr, int nr, bool accumulate,
+                            gemm_epilogue epilogue) {
+  float tile[GEMM_NR * GEMM_MR] = {0};
+  for (int k = 0; k < kc; ++k) {
+    for (int j = 0; j < GEMM_NR; ++j) {
+      for (int r = 0; r < GEMM_MR; ++r) {
+        tile[j * GEMM_MR + r] += a[r] * b[j];
+      }
+    }
+    a += GEMM_MR;
+    b += GEMM_NR;
+  }
+  store_tile (tile, c, ldc, mr, nr, accumulate, epilogue);
+}
+
+#ifdef GEMM_X86
+/**
+ * AVX2/FMA micro-kernel, C tile (+)= A panel * B panel.
+ * Every column of the 16 x 6 tile lives in two registers, so every k costs
+ * two loads of A, six broadcasts of B and twelve fused multiply-adds.
+ * @param kc length of the panels
+ * @param a packed A panel
+ * @param b packed B panel
+ * @param c first element of the tile in C
+ * @param ldc row stride of C
+ * @param mr valid rows
+ * @param nr valid cols
+ * @param accumulate add to C instead of overwriting it
+ * @param epilogue applied while storing the tile
+ */
+__attribute__ ((target ("avx2,fma")))
+static void kernel_avx2 (int kc, const float *a, const float *b, float *c,
+                         int ldc, int mr, int nr, bool accumulate,
+                         gemm_epilogue epilogue) {
+  __m256 c00 = _mm256_setzero_ps (), c10 = _mm256_setzero_ps ();
+  __m256 c01 = _mm256_setzero_ps (), c11 = _mm256_setzero_ps ();
+  __m256 c02 = _mm256_setzero_ps (), c12 = _mm256_setzero_ps ();
+  __m256 c03 = _mm256_setzero_ps (), c13 = _mm256_setzero_ps ();
+  __m256 c04 = _mm256_setzero_ps (), c14 = _mm256_setzero_ps ();
+  __m256 c05 = _mm256_setzero_ps (), c15 = _mm256_setzero_ps ();
+  for (int k = 0; k < kc; ++k) {
+    __m256 a0 = _mm256_loadu_ps (a);
+    __m256 a1 = _mm256_loadu_ps (a + 8);
+    __m256 bj = _mm256_broadcast_ss (b);
+    c00 = _mm256_fmadd_ps (a0, bj, c00);
+    c10 = _mm256_fmadd_ps (a1, bj, c10);
+    bj = _mm256_broadcast_ss (b + 1);
+    c01 = _mm256_fmadd_ps (a0, bj, c01);
+    c11 = _mm256_fmadd_ps (a1, bj, c11);
+    bj = _mm256_broadcast_ss (b + 2);
+    c02 = _mm256_fmadd_ps (a0, bj, c02);
+    c12 = _mm256_fmadd_ps (a1, bj, c12);
+    bj = _mm256_broadcast_ss (b + 3);
+    c03 = _mm256_fmadd_ps (a0, bj, c03);
+    c13 = _mm256_fmadd_ps (a1, bj, c13);
+    bj = _mm256_broadcast_ss (b + 4);
+    c04 = _mm256_fmadd_ps (a0, bj, c04);
+    c14 = _mm256_fmadd_ps (a1, bj, c14);
+    bj = _mm256_broadcast_ss (b + 5);
+    c05 = _mm256_fmadd_ps (a0, bj, c05);
+    c15 = _mm256_fmadd_ps (a1, bj, c15);
+    a += GEMM_MR;
+    b += GEMM_NR;
+  }
+  float tile[GEMM_NR * GEMM_MR];
+  _mm256_storeu_ps (tile, c00);
+  _mm256_storeu_ps (tile + 8, c10);
+  _mm256_storeu_ps (tile + 16, c01);
+  _mm256_storeu_ps (tile + 24, c11);
+  _mm256_storeu_ps (tile + 32, c02);
+  _mm256_storeu_ps (tile + 40, c12);
+  _mm256_storeu_ps (tile + 48, c03);
+  _mm256_storeu_ps (tile + 56, c13);
+  _mm256_storeu_ps (tile + 64, c04);
+  _mm256_storeu_ps (tile + 72, c14);
+  _mm256_storeu_ps (tile + 80, c05);
+  _mm256_storeu_ps (tile + 88, c15);
+  store_tile (tile, c, ldc, mr, nr, accumulate, epilogue);
+}
+#endif
+
+typedef void (*gemm_kernel) (int, const float *, const float *, float *, int,
+                             int, int, bool, gemm_epilogue);
+
+/**
+ * Picks the fastest micro-kernel the cpu can run, once.
+ * @return the micro-kernel
+ */
+static gemm_kernel select_kernel () {
+#ifdef GEMM_X86
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma")) {
+    return kernel_avx2;
+  }
+#endif
+  return kernel_generic;
+}
+
+/**
+ * The blocked product of gemm, gemm_strided and gemm_packed
+ * @param m rows of A and C
+ * @param n cols of B and C
+ * @param k cols of A and rows of B
+ * @param a first element of A, unused when prepacked is set
+ * @param rsa row stride of A
+ * @param csa col stride of A
+ * @param prepacked A in whole panels (see gemm_pack), or null to pack the
+ * blocks of a on the way
+ * @param b first element of B
+ * @param rsb row stride of B
+ * @param csb col stride of B
+ * @param c first element of C, overwritten with the product
+ * @param ldc row stride of C
+ * @param epilogue bias / relu fused into the store of C
+ */
+static void gemm_blocked (int m, int n, int k, const float *a, int rsa,
+                          int csa, const float *prepacked, const float *b,
+                          int rsb, int csb, float *c, int ldc,
+                          gemm_epilogue epilogue) {
+  static const gemm_kernel kernel = select_kernel ();
+  // packing buffers are reused by all the products of the thread
+  static thread_local std::vector<float> packed_a, packed_b;
+  packed_a.resize (GEMM_MC * GEMM_KC);
+  packed_b.resize (GEMM_KC * (GEMM_NC + GEMM_NR));
+
+  if (k == 0) {
+    float tile[GEMM_NR * GEMM_MR] = {0};
+    for (int r = 0; r < m; r += GEMM_MR) {
+      for (int j = 0; j < n; j += GEMM_NR) {
+        gemm_epilogue tile_epilogue = {
+            epilogue.bias == nullptr ? nullptr : epilogue.bias + r,
+            epilogue.relu};
+        store_tile (tile, c + r * ldc + j, ldc, std::min (GEMM_MR, m - r),
+                    std::min (GEMM_NR, n - j), false, tile_epilogue);
+      }
+    }
+    return;
+  }
+  for (int jc = 0; jc < n; jc += GEMM_NC) {
+    int nc = std::min (GEMM_NC, n - jc);
+    for (int pc = 0; pc < k; pc += GEMM_KC) {
+      int kc = std::min (GEMM_KC, k - pc);
+      bool last = pc + kc == k;
+      pack_b (kc, nc, b + (size_t) pc * rsb + (size_t) jc * csb, rsb, csb,
+              packed_b.data ());
+      for (int ic = 0; ic < m; ic += GEMM_MC) {
+        int mc = std::min (GEMM_MC, m - ic);
+        if (prepacked == nullptr) {
+          pack_a (mc, kc, a + (size_t) ic * rsa + (size_t) pc * csa, rsa,
+                  csa, packed_a.data ());
+        }
+        for (int jr = 0; jr < nc; jr += GEMM_NR) {
+          for (int ir = 0; ir < mc; ir += GEMM_MR) {
+            // the kc slice of the panel: contiguous in both layouts
+            const float *panel = prepacked == nullptr
+                                 ? packed_a.data () + ir * kc
+                                 : prepacked + (size_t) (ic + ir) * k
+                                   + (size_t) pc * GEMM_MR;
+            gemm_epilogue tile_epilogue = {nullptr, false};
+            if (last) {
+              tile_epilogue.relu = epilogue.relu;
+              if (epilogue.bias != nullptr) {
+                tile_epilogue.bias = epilogue.bias + ic + ir;
+              }
+            }
+            kernel (kc, panel, packed_b.data () + jr * kc,
+                    c + (ic + ir) * ldc + jc + jr, ldc,
+                    std::min (GEMM_MR, mc - ir), std::min (GEMM_NR, nc - jr),
+                    pc > 0, tile_epilogue);
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Computes C = A * B for row-major matrices, see Gemm.h
+ */
+void gemm (int m, int n, int k, const float *a, int lda,
+           const float *b, int ldb, float *c, int ldc,
+           gemm_epilogue epilogue) {
+  gemm_blocked (m, n, k, a, lda, 1, nullptr, b, ldb, 1, c, ldc, epilogue);
+}
+
+/**
+ * Computes C = A * B for strided matrices, see Gemm.h
+ */
+void gemm_strided (int m, int n, int k, const float *a, int rsa, int csa,
+                   const float *b, int rsb, int csb, float *c, int ldc,
+                   gemm_epilogue epilogue) {
+  if (csa == 1 && n <= GEMV_MAX_VECTORS && (csb == 1 || n == 1)) {
+    gemv (m, n, k, a, rsa, b, rsb, c, ldc, epilogue);
+    return;
+  }
+  gemm_blocked (m, n, k, a, rsa, csa, nullptr, b, rsb, csb, c, ldc,
+                epilogue);
+}
+
+/**
+ * Floats of A packed by gemm_pack, see Gemm.h
+ */
+size_t gemm_packed_size (int m, int k) {
+  return (size_t) (m + GEMM_MR - 1) / GEMM_MR * GEMM_MR * k;
+}
+
+/**
+ * Copies A into whole panels, see Gemm.h
+ */
+void gemm_pack (int m, int k, const float *a, int rsa, int csa,
+                float *packed) {
+  pack_a (m, k, a, rsa, csa, packed);
+}
+
+/**
+ * bias and relu of one output
+ * @param value product of the output
+ * @param row row of the output
+ * @param epilogue bias / relu to apply
+ * @return the output
+ */
+static inline float finish (float value, int row, gemm_epilogue epilogue) {
+  if (epilogue.bias != nullptr) {
+    value += epilogue.bias[row];
+  }
+  if (epilogue.relu && value < 0) {
+    value = 0;
+  }
+  return value;
+}
+
+/**
+ * Stores one result of a matrix-vector product
+ * @param sum product over the current block of k
+ * @param c the result in C
+ * @param row row of the result
+ * @param accumulate add to C instead of overwriting it
+ * @param epilogue only set on the last block of k
+ */
+static inline void store_result (float sum, float *c, int row,
+                                 bool accumulate, gemm_epilogue epilogue) {
+  if (accumulate) {
+    sum += *c;
+  }
+  *c = finish (sum, row, epilogue);
+}
+
+/**
+ * Portable row-by-row product of A with n contiguous vectors
+ * @param m rows of A
+ * @param n number of vectors
+ * @param k length of the rows and of the vectors
+ * @param a first element of A
+ * @param lda row stride of A
+ * @param x the vectors, x + j * k is vector j
+ * @param c receives the results
+ * @param ldc row stride of C
+ * @param accumulate add to C instead of overwriting it
+ * @param epilogue applied on every result
+ */
+static void gemv_generic (int m, int n, int k, const float *a, int lda,
+                          const float *x, float *c, int ldc, bool accumulate,
+                          gemm_epilogue epilogue) {
+  for (int r = 0; r < m; ++r) {
+    const float *row = a + (size_t) r * lda;
+    for (int j = 0; j < n; ++j) {
+      const float *vector = x + (size_t) j * k;
+      float lanes[8] = {0};
+      int i = 0;
+      for (; i + 8 <= k; i += 8) {
+        for (int l = 0; l < 8; ++l) {
+          lanes[l] += row[i + l] * vector[i + l];
+        }
+      }
+      float sum = 0;
+      for (; i < k; ++i) {
+        sum += row[i] * vector[i];
+      }
+      for (int l = 0; l < 8; ++l) {
+        sum += lanes[l];
+      }
+      store_result (sum, c + (size_t) r * ldc + j, r, accumulate, epilogue);
+    }
+  }
+}
+
+#ifdef GEMM_X86
+/**
+ * sums the eight lanes of a register
+ * @param v the register
+ * @return the sum
+ */
+__attribute__ ((target ("avx2")))
+static inline float horizontal_sum (__m256 v) {
+  __m128 sum = _mm_add_ps (_mm256_castps256_ps128 (v),
+                           _mm256_extractf128_ps (v, 1));
+  sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+  sum = _mm_add_ss (sum, _mm_movehdup_ps (sum));
+  return _mm_cvtss_f32 (sum);
+}
+
+/**
+ * AVX2/FMA product of A with a single vector: four independent
+ * accumulators hide the latency of the fused multiply-adds
+ * @param m rows of A
+ * @param k length of the rows and of the vector
+ * @param a first element of A
+ * @param lda row stride of A
+ * @param x the vector
+ * @param c receives the results
+ * @param ldc row stride of C
+ * @param accumulate add to C instead of overwriting it
+ * @param epilogue applied on every result
+ */
+__attribute__ ((target ("avx2,fma")))
+static void gemv_avx2_single (int m, int k, const float *a, int lda,
+                              const float *x, float *c, int ldc,
+                              bool accumulate, gemm_epilogue epilogue) {
+  for (int r = 0; r < m; ++r) {
+    const float *row = a + (size_t) r * lda;
+    __m256 acc0 = _mm256_setzero_ps (), acc1 = _mm256_setzero_ps ();
+    __m256 acc2 = _mm256_setzero_ps (), acc3 = _mm256_setzero_ps ();
+    int i = 0;
+    for (; i + 32 <= k; i += 32) {
+      acc0 = _mm256_fmadd_ps (_mm256_loadu_ps (row + i),
+                              _mm256_loadu_ps (x + i), acc0);
+      acc1 = _mm256_fmadd_ps (_mm256_loadu_ps (row + i + 8),
+                              _mm256_loadu_ps (x + i + 8), acc1);
+      acc2 = _mm256_fmadd_ps (_mm256_loadu_ps (row + i + 16),
+                              _mm256_loadu_ps (x + i + 16), acc2);
+      acc3 = _mm256_fmadd_ps (_mm256_loadu_ps (row + i + 24),
+                              _mm256_loadu_ps (x + i + 24), acc3);
+    }
+    for (; i + 8 <= k; i += 8) {
+      acc0 = _mm256_fmadd_ps (_mm256_loadu_ps (row + i),
+                              _mm256_loadu_ps (x + i), acc0);
+    }
+    float sum = horizontal_sum (_mm256_add_ps (_mm256_add_ps (acc0, acc1),
+                                               _mm256_add_ps (acc2, acc3)));
+    for (; i < k; ++i) {
+      sum += row[i] * x[i];
+    }
+    store_result (sum, c + (size_t) r * ldc, r, accumulate, epilogue);
+  }
+}
+
+/**
+ * AVX2/FMA product of Rows rows of A with N vectors: every piece of a row
+ * is loaded once and multiplied with the N vectors, every piece of a
+ * vector with the Rows rows, one accumulator per result
+ * @param k length of the rows and of the vectors
+ * @param a first row
+ * @param lda row stride of A
+ * @param x the vectors, x + j * k is vector j
+ * @param c first result of the first row
+ * @param ldc row stride of C
+ * @param row index of the first row (for the bias)
+ * @param accumulate add to C instead of overwriting it
+ * @param epilogue applied on every result
+ */
+template<int N, int Rows>
+__attribute__ ((target ("avx2,fma")))
+static inline void gemv_avx2_rows (int k, const float *a, int lda,
+                                   const float *x, float *c, int ldc,
+                                   int row, bool accumulate,
+                                   gemm_epilogue epilogue) {
+  __m256 acc[Rows][N];
+#pragma GCC unroll 8
+  for (int r = 0; r < Rows; ++r) {
+#pragma GCC unroll 8
+    for (int j = 0; j < N; ++j) {
+      acc[r][j] = _mm256_setzero_ps ();
+    }
+  }
+  int i = 0;
+  for (; i + 8 <= k; i += 8) {
+    __m256 pieces[Rows];
+#pragma GCC unroll 8
+    for (int r = 0; r < Rows; ++r) {
+      pieces[r] = _mm256_loadu_ps (a + (size_t) r * lda + i);
+    }
+#pragma GCC unroll 8
+    for (int j = 0; j < N; ++j) {
+      __m256 piece = _mm256_loadu_ps (x + (size_t) j * k + i);
+#pragma GCC unroll 8
+      for (int r = 0; r < Rows; ++r) {
+        acc[r][j] = _mm256_fmadd_ps (pieces[r], piece, acc[r][j]);
+      }
+    }
+  }
+  for (int r = 0; r < Rows; ++r) {
+    const float *rest = a + (size_t) r * lda;
+    for (int j = 0; j < N; ++j) {
+      float sum = horizontal_sum (acc[r][j]);
+      for (int t = i; t < k; ++t) {
+        sum += rest[t] * x[(size_t) j * k + t];
+      }
+      store_result (sum, c + (size_t) r * ldc + j, row + r, accumulate,
+                    epilogue);
+    }
+  }
+}
+
+/**
+ * AVX2/FMA product of A with N vectors. Few vectors run on two (up to
+ * four vectors) or four (two vectors) rows together, so that enough
+ * independent accumulators hide the latency of the fused multiply-adds
+ * and every piece of a vector serves several rows.
+ * @param m rows of A
+ * @param k length of the rows and of the vectors
+ * @param a first element of A
+ * @param lda row stride of A
+ * @param x the vectors, x + j * k is vector j
+ * @param c receives the results
+ * @param ldc row stride of C
+ * @param accumulate add to C instead of overwriting it
+ * @param epilogue applied on every result
+ */
+template<int N>
+__attribute__ ((target ("avx2,fma")))
+static void gemv_avx2_batch (int m, int k, const float *a, int lda,
+                             const float *x, float *c, int ldc,
+                             bool accumulate, gemm_epilogue epilogue) {
+  const int rows = N <= 2 ? 4 : N <= 4 ? 2 : 1;
+  int r = 0;
+  for (; r + rows <= m; r += rows) {
+    gemv_avx2_rows<N, rows> (k, a + (size_t) r * lda, lda, x,
+                             c + (size_t) r * ldc, ldc, r, accumulate,
+                             epilogue);
+  }
+  for (; r < m; ++r) {
+    gemv_avx2_rows<N, 1> (k, a + (size_t) r * lda, lda, x,
+                          c + (size_t) r * ldc, ldc, r, accumulate,
+                          epilogue);
+  }
+}
+
+/**
+ * AVX2/FMA row-by-row product of A with n contiguous vectors
+ * @param m rows of A
+ * @param n number of vectors
+ * @param k length of the rows and of the vectors
+ * @param a first element of A
+ * @param lda row stride of A
+ * @param x the vectors, x + j * k is vector j
+ * @param c receives the results
+ * @param ldc row stride of C
+ * @param accumulate add to C instead of overwriting it
+ * @param epilogue applied on every result
+ */
+static void gemv_avx2 (int m, int n, int k, const float *a, int lda,
+                       const float *x, float *c, int ldc, bool accumulate,
+                       gemm_epilogue epilogue) {
+  switch (n) {
+    case 1:
+      gemv_avx2_single (m, k, a, lda, x, c, ldc, accumulate, epilogue);
+      break;
+    case 2:
+      gemv_avx2_batch<2> (m, k, a, lda, x, c, ldc, accumulate, epilogue);
+      break;
+    case 3:
+      gemv_avx2_batch<3> (m, k, a, lda, x, c, ldc, accumulate, epilogue);
+      break;
+    case 4:
+      gemv_avx2_batch<4> (m, k, a, lda, x, c, ldc, accumulate, epilogue);
+      break;
+    case 5:
+      gemv_avx2_batch<5> (m, k, a, lda, x, c, ldc, accumulate, epilogue);
+      break;
+    case 6:
+      gemv_avx2_batch<6> (m, k, a, lda, x, c, ldc, accumulate, epilogue);
+      break;
+    case 7:
+      gemv_avx2_batch<7> (m, k, a, lda, x, c, ldc, accumulate, epilogue);
+      break;
+    default:
+      gemv_avx2_batch<8> (m, k, a, lda, x, c, ldc, accumulate, epilogue);
+      break;
+  }
+}
+#endif
+
+typedef void (*gemv_kernel) (int, int, int, const float *, int,
+                             const float *, float *, int, bool,
+                             gemm_epilogue);
+
+/**
+ * Picks the fastest matrix-vector kernel the cpu can run, once.
+ * @return the kernel
+ */
+static gemv_kernel select_gemv_kernel () {
+#ifdef GEMM_X86
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma")) {
+    return gemv_avx2;
+  }
+#endif
+  return gemv_generic;
+}
+
+/**
+ * Computes C = A * B for B of at most GEMV_MAX_VECTORS columns, see
+ * Gemm.h. Several vectors are copied, GEMV_KC rows of B at a time, into a
+ * stack buffer where each is contiguous, so nothing is allocated.
+ */
+void gemv (int m, int n, int k, const float *a, int lda,
+           const float *b, int ldb, float *c, int ldc,
+           gemm_epilogue epilogue) {
+  if (n > GEMV_MAX_VECTORS) {
+    gemm (m, n, k, a, lda, b, ldb, c, ldc, epilogue);
+    return;
+  }
+  static const gemv_kernel kernel = select_gemv_kernel ();
+  bool contiguous = n == 1 && ldb == 1;
+  int chunk = contiguous ? k : GEMV_KC;
+  float vectors[GEMV_MAX_VECTORS * GEMV_KC];
+  int pc = 0;
+  do {
+    int kc = std::min (chunk, k - pc);
+    const float *x = b + (size_t) pc * ldb;
+    if (!contiguous) {
+      for (int i = 0; i < kc; ++i) {
+        for (int j = 0; j < n; ++j) {
+          vectors[j * kc + i] = x[(size_t) i * ldb + j];
+        }
+      }
+      x = vectors;
+    }
+    bool last = pc + kc == k;
+    gemm_epilogue chunk_epilogue = last ? epilogue
+                                        : gemm_epilogue {nullptr, false};
+    kernel (m, n, kc, a + pc, lda, x, c, ldc, pc > 0, chunk_epilogue);
+    pc += kc;
+  } while (pc < k);
+}
+
+/**
+ * Portable product of one packed panel with up to GEMV_GROUP vectors
+ * @param n number of vectors
+ * @param k length of the panel
+ * @param panel k x GEMM_MR packed weights
+ * @param b first vector element, b[i * ldb + j] is element i of vector j
+ * @param ldb row stride of B
+ * @param tile receives the results, tile[j * GEMM_MR + r]
+ */
+static void panel_gemv_generic (int n, int k, const float *panel,
+                                const float *b, int ldb, float *tile) {
+  for (int t = 0; t < n * GEMM_MR; ++t) {
+    tile[t] = 0;
+  }
+  for (int i = 0; i < k; ++i) {
+    for (int j = 0; j < n; ++j) {
+      float value = b[(size_t) i * ldb + j];
+      for (int r = 0; r < GEMM_MR; ++r) {
+        tile[j * GEMM_MR + r] += panel[r] * value;
+      }
+    }
+    panel += GEMM_MR;
+  }
+}
+
+/**
+ * Portable product of one packed panel with a sparse vector
+ * @param panel k x GEMM_MR packed weights
+ * @param x the vector
+ * @param nonzeros indexes of the non zero elements of x
+ * @param count number of indexes
+ * @param tile receives the GEMM_MR results
+ */
+static void panel_sparse_generic (const float *panel, const float *x,
+                                  const int32_t *nonzeros, int count,
+                                  float *tile) {
+  for (int r = 0; r < GEMM_MR; ++r) {
+    tile[r] = 0;
+  }
+  for (int i = 0; i < count; ++i) {
+    const float *column = panel + (size_t) nonzeros[i] * GEMM_MR;
+    float value = x[nonzeros[i]];
+    for (int r = 0; r < GEMM_MR; ++r) {
+      tile[r] += column[r] * value;
+    }
+  }
+}
+
+#ifdef GEMM_X86
+/**
+ * AVX2/FMA product of one packed panel with N vectors: every k step loads
+ * the two (64 byte aligned) registers of the panel column and broadcasts
+ * one element per vector. Unroll steps run in separate accumulators, so
+ * that every product has at least eight independent FMA chains.
+ * @param k length of the panel
+ * @param panel k x GEMM_MR packed weights, 64 bytes aligned
+ * @param b first vector element, b[i * ldb + j] is element i of vector j
+ * @param ldb row stride of B
+ * @param tile receives the results, tile[j * GEMM_MR + r]
+ */
+template<int N, int Unroll>
+__attribute__ ((target ("avx2,fma")))
+static inline void panel_gemv_avx2_n (int k, const float *panel,
+                                      const float *b, int ldb, float *tile) {
+  __m256 acc[Unroll][N][2];
+#pragma GCC unroll 16
+  for (int u = 0; u < Unroll; ++u) {
+#pragma GCC unroll 8
+    for (int j = 0; j < N; ++j) {
+      acc[u][j][0] = _mm256_setzero_ps ();
+      acc[u][j][1] = _mm256_setzero_ps ();
+    }
+  }
+  int i = 0;
+  for (; i + Unroll <= k; i += Unroll) {
+#pragma GCC unroll 16
+    for (int u = 0; u < Unroll; ++u) {
+      const float *column = panel + (size_t) (i + u) * GEMM_MR;
+      __m256 a0 = _mm256_load_ps (column);
+      __m256 a1 = _mm256_load_ps (column + 8);
+#pragma GCC unroll 8
+      for (int j = 0; j < N; ++j) {
+        __m256 value = _mm256_broadcast_ss (b + (size_t) (i + u) * ldb + j);
+        acc[u][j][0] = _mm256_fmadd_ps (a0, value, acc[u][j][0]);
+        acc[u][j][1] = _mm256_fmadd_ps (a1, value, acc[u][j][1]);
+      }
+    }
+  }
+  for (; i < k; ++i) {
+    const float *column = panel + (size_t) i * GEMM_MR;
+    __m256 a0 = _mm256_load_ps (column);
+    __m256 a1 = _mm256_load_ps (column + 8);
+#pragma GCC unroll 8
+    for (int j = 0; j < N; ++j) {
+      __m256 value = _mm256_broadcast_ss (b + (size_t) i * ldb + j);
+      acc[0][j][0] = _mm256_fmadd_ps (a0, value, acc[0][j][0]);
+      acc[0][j][1] = _mm256_fmadd_ps (a1, value, acc[0][j][1]);
+    }
+  }
+#pragma GCC unroll 8
+  for (int j = 0; j < N; ++j) {
+#pragma GCC unroll 16
+    for (int u = 1; u < Unroll; ++u) {
+      acc[0][j][0] = _mm256_add_ps (acc[0][j][0], acc[u][j][0]);
+      acc[0][j][1] = _mm256_add_ps (acc[0][j][1], acc[u][j][1]);
+    }
+    _mm256_storeu_ps (tile + j * GEMM_MR, acc[0][j][0]);
+    _mm256_storeu_ps (tile + j * GEMM_MR + 8, acc[0][j][1]);
+  }
+}
+
+/**
+ * AVX2/FMA product of one packed panel with up to GEMV_GROUP vectors
+ * @param n number of vectors
+ * @param k length of the panel
+ * @param panel k x GEMM_MR packed weights, 64 bytes aligned
+ * @param b first vector element, b[i * ldb + j] is element i of vector j
+ * @param ldb row stride of B
+ * @param tile receives the results, tile[j * GEMM_MR + r]
+ */
+static void panel_gemv_avx2 (int n, int k, const float *panel,
+                             const float *b, int ldb, float *tile) {
+  switch (n) {
+    case 1:
+      panel_gemv_avx2_n<1, 4> (k, panel, b, ldb, tile);
+      break;
+    case 2:
+      panel_gemv_avx2_n<2, 2> (k, panel, b, ldb, tile);
+      break;
+    case 3:
+      panel_gemv_avx2_n<3, 1> (k, panel, b, ldb, tile);
+      break;
+    default:
+      panel_gemv_avx2_n<4, 1> (k, panel, b, ldb, tile);
+      break;
+  }
+}
+
+/**
+ * AVX2/FMA product of one packed panel with a sparse vector: only the
+ * panel columns of the listed elements are read, two at a time in
+ * separate accumulators
+ * @param panel k x GEMM_MR packed weights, 64 bytes aligned
+ * @param x the vector
+ * @param nonzeros indexes of the non zero elements of x
+ * @param count number of indexes
+ * @param tile receives the GEMM_MR results
+ */
+__attribute__ ((target ("avx2,fma")))
+static void panel_sparse_avx2 (const float *panel, const float *x,
+                               const int32_t *nonzeros, int count,
+                               float *tile) {
+  __m256 acc0 = _mm256_setzero_ps (), acc1 = _mm256_setzero_ps ();
+  __m256 acc2 = _mm256_setzero_ps (), acc3 = _mm256_setzero_ps ();
+  int i = 0;
+  for (; i + 2 <= count; i += 2) {
+    const float *column0 = panel + (size_t) nonzeros[i] * GEMM_MR;
+    const float *column1 = panel + (size_t) nonzeros[i + 1] * GEMM_MR;
+    __m256 value0 = _mm256_broadcast_ss (x + nonzeros[i]);
+    __m256 value1 = _mm256_broadcast_ss (x + nonzeros[i + 1]);
+    acc0 = _mm256_fmadd_ps (_mm256_load_ps (column0), value0, acc0);
+    acc1 = _mm256_fmadd_ps (_mm256_load_ps (column0 + 8), value0, acc1);
+    acc2 = _mm256_fmadd_ps (_mm256_load_ps (column1), value1, acc2);
+    acc3 = _mm256_fmadd_ps (_mm256_load_ps (column1 + 8), value1, acc3);
+  }
+  if (i < count) {
+    const float *column = panel + (size_t) nonzeros[i] * GEMM_MR;
+    __m256 value = _mm256_broadcast_ss (x + nonzeros[i]);
+    acc0 = _mm256_fmadd_ps (_mm256_load_ps (column), value, acc0);
+    acc1 = _mm256_fmadd_ps (_mm256_load_ps (column + 8), value, acc1);
+  }
+  _mm256_storeu_ps (tile, _mm256_add_ps (acc0, acc2));
+  _mm256_storeu_ps (tile + 8, _mm256_add_ps (acc1, acc3));
+}
+#endif
+
+typedef void (*panel_gemv_kernel) (int, int, const float *, const float *,
+                                   int, float *);
+typedef void (*panel_sparse_kernel) (const float *, const float *,
+                                     const int32_t *, int, float *);
+
+/**
+ * Picks the fastest packed panel kernel the cpu can run, once.
+ * @return the kernel
+ */
+static panel_gemv_kernel select_panel_gemv_kernel () {
+#ifdef GEMM_X86
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma")) {
+    return panel_gemv_avx2;
+  }
+#endif
+  return panel_gemv_generic;
+}
+
+/**
+ * Picks the fastest packed panel sparse kernel the cpu can run, once.
+ * @return the kernel
+ */
+static panel_sparse_kernel select_panel_sparse_kernel () {
+#ifdef GEMM_X86
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma")) {
+    return panel_sparse_avx2;
+  }
+#endif
+  return panel_sparse_generic;
+}
+
+/**
+ * Computes C = A * B for A packed by gemm_pack, see Gemm.h
+ */
+void gemm_packed (int m, int n, int k, const float *packed,
+                  const float *b, int ldb, float *c, int ldc,
+                  gemm_epilogue epilogue) {
+  if (n > GEMV_MAX_VECTORS) {
+    gemm_blocked (m, n, k, nullptr, 0, 0, packed, b, ldb, 1, c, ldc,
+                  epilogue);
+    return;
+  }
+  static const panel_gemv_kernel kernel = select_panel_gemv_kernel ();
+  float tile[GEMV_GROUP * GEMM_MR];
+  for (int p = 0; p < m; p += GEMM_MR) {
+    const float *panel = packed + (size_t) p * k;
+    gemm_epilogue panel_epilogue = {
+        epilogue.bias == nullptr ? nullptr : epilogue.bias + p,
+        epilogue.relu};
+    for (int j = 0; j < n; j += GEMV_GROUP) {
+      int vectors = std::min (GEMV_GROUP, n - j);
+      kernel (vectors, k, panel, b + j, ldb, tile);
+      store_tile (tile, c + (size_t) p * ldc + j, ldc,
+                  std::min (GEMM_MR, m - p), vectors, false, panel_epilogue);
+    }
+  }
+}
+
+/**
+ * Computes y = A * x for A packed by gemm_pack and a mostly zero x, see
+ * Gemm.h
+ */
+void gemv_packed_sparse_input (int m, int k, const float *packed,
+                               const float *x, const int32_t *nonzeros,
+                               int count, float *y, gemm_epilogue epilogue) {
+  static const panel_sparse_kernel kernel = select_panel_sparse_kernel ();
+  float tile[GEMM_MR];
+  for (int p = 0; p < m; p += GEMM_MR) {
+    gemm_epilogue panel_epilogue = {
+        epilogue.bias == nullptr ? nullptr : epilogue.bias + p,
+        epilogue.relu};
+    kernel (packed + (size_t) p * k, x, nonzeros, count, tile);
+    store_tile (tile, y + p, 1, std::min (GEMM_MR, m - p), 1, false,
+                panel_epilogue);
+  }
+}
@@ -0,0 +1,186 @@
+// Gemm.h
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Rows of A (and of C) handled by one call of the micro-kernel.
+ */
+#define GEMM_MR 16
+
+/**
+ * Columns of B (and of C) handled by one call of the micro-kernel.
+ */
+#define GEMM_NR 6
+
+/**
+ * Cache blocking sizes: a KC x NR panel of B stays in L1, an MC x KC block
+ * of A stays in L2 and a KC x NC block of B stays in L3.
+ */
+#define GEMM_KC 256
+#define GEMM_MC 128
+#define GEMM_NC 1536
+
+/**
+ * Most columns of B (vectors) worth a matrix-vector product instead of
+ * the blocked gemm.
+ */
+#define GEMV_MAX_VECTORS 8
+
+/**
+ * Rows of B copied at a time when B has several columns.
+ */
+#define GEMV_KC 512
+
+/**
+ * Vectors multiplied together with a packed panel.
+ */
+#define GEMV_GROUP 4
+
+/**
+ * Alignment of packed matrices, in bytes: every GEMM_MR floats of a panel
+ * (one k step) fill a cache line.
+ */
+#define GEMM_PACK_ALIGNMENT 64
+
+/**
+ * @struct gemm_epilogue
+ * @brief Work applied on every element of C in the same pass that stores
+ * it: add bias[row] (when bias is not null) and then clamp negative values
+ * to zero (when relu is set).
+ */
+typedef struct gemm_epilogue {
+    const float *bias;
+    bool relu;
+} gemm_epilogue;
+
+/**
+ * Computes C = A * B for row-major matrices.
+ * A is m x k, B is k x n and C is m x n, every matrix is given by a pointer
+ * to its first element and the distance (in floats) between its rows.
+ * The product is cache blocked, and runs an AVX2/FMA micro-kernel when the
+ * cpu supports it (a portable kernel otherwise).
+ * @param m rows of A and C
+ * @param n cols of B and C
+ * @param k cols of A and rows of B
+ * @param a first element of A
+ * @param lda row stride of A
+ * @param b first element of B
+ * @param ldb row stride of B
+ * @param c first element of C, overwritten with the product
+ * @param ldc row stride of C
+ * @param epilogue bias / relu fused into the store of C
+ */
+void gemm (int m, int n, int k, const float *a, int lda,
+           const float *b, int ldb, float *c, int ldc,
+           gemm_epilogue epilogue = gemm_epilogue {nullptr, false});
+
+/**
+ * Computes C = A * B for matrices with any element strides: element (i, j)
+ * of A is a[i * rsa + j * csa], so a transposed row-major matrix is given
+ * by swapping its strides and is never copied (same for B). The packing of
+ * the blocked gemm absorbs the strides; a row-major A with a few vectors
+ * runs gemv.
+ * @param m rows of A and C
+ * @param n cols of B and C
+ * @param k cols of A and rows of B
+ * @param a first element of A
+ * @param rsa row stride of A
+ * @param csa col stride of A
+ * @param b first element of B
+ * @param rsb row stride of B
+ * @param csb col stride of B
+ * @param c first element of C, overwritten with the product
+ * @param ldc row stride of C
+ * @param epilogue bias / relu fused into the store of C
+ */
+void gemm_strided (int m, int n, int k, const float *a, int rsa, int csa,
+                   const float *b, int rsb, int csb, float *c, int ldc,
+                   gemm_epilogue epilogue = gemm_epilogue {nullptr, false});
+
+/**
+ * Computes C = A * B for row-major matrices when B has at most
+ * GEMV_MAX_VECTORS columns (vectors), same arguments as gemm.
+ * Such products are bound by the reads of A, so A is streamed once, row
+ * by row, without packing: every loaded piece of a row is multiplied with
+ * all the vectors, in independent accumulators reduced horizontally at the
+ * end of the row. Runs an AVX2/FMA kernel when the cpu supports it.
+ * @param m rows of A and C
+ * @param n cols of B and C, 1 to GEMV_MAX_VECTORS (more run gemm)
+ * @param k cols of A and rows of B
+ * @param a first element of A
+ * @param lda row stride of A
+ * @param b first element of B
+ * @param ldb row stride of B
+ * @param c first element of C, overwritten with the product
+ * @param ldc row stride of C
+ * @param epilogue bias / relu fused into the store of C
+ */
+void gemv (int m, int n, int k, const float *a, int lda,
+           const float *b, int ldb, float *c, int ldc,
+           gemm_epilogue epilogue = gemm_epilogue {nullptr, false});
+
+/**
+ * @param m rows of A
+ * @param k cols of A
+ * @return floats of A packed by gemm_pack
+ */
+size_t gemm_packed_size (int m, int k);
+
+/**
+ * Copies A once into the layout the micro-kernels read: panels of GEMM_MR
+ * rows, one after the other, holding the GEMM_MR elements of every column
+ * contiguously (packed[(p * k + i) * GEMM_MR + r] is element
+ * (p * GEMM_MR + r, i)). Rows past m are zero.
+ * @param m rows of A
+ * @param k cols of A
+ * @param a first element of A
+ * @param rsa row stride of A
+ * @param csa col stride of A
+ * @param packed destination, gemm_packed_size (m, k) floats
+ */
+void gemm_pack (int m, int k, const float *a, int rsa, int csa,
+                float *packed);
+
+/**
+ * Computes C = A * B for A packed by gemm_pack, same arguments as gemm.
+ * Nothing is packed on the way: up to GEMV_MAX_VECTORS columns of B
+ * stream every panel once per GEMV_GROUP vectors, broadcasting one
+ * element of every vector per panel column, wider B runs the blocked gemm
+ * on the packed panels. The aligned panels are read with aligned loads by
+ * the AVX2/FMA kernels (when the cpu supports them).
+ * @param m rows of A and C
+ * @param n cols of B and C
+ * @param k cols of A and rows of B
+ * @param packed A packed by gemm_pack, GEMM_PACK_ALIGNMENT aligned
+ * @param b first element of B
+ * @param ldb row stride of B
+ * @param c first element of C, overwritten with the product
+ * @param ldc row stride of C
+ * @param epilogue bias / relu fused into the store of C
+ */
+void gemm_packed (int m, int n, int k, const float *packed,
+                  const float *b, int ldb, float *c, int ldc,
+                  gemm_epilogue epilogue = gemm_epilogue {nullptr, false});
+
+/**
+ * Computes y = A * x for A packed by gemm_pack and a vector x that is
+ * mostly zeros: only the panel columns at the non zero elements of x are
+ * read and accumulated.
+ * @param m rows of A, length of y
+ * @param k cols of A, length of x
+ * @param packed A packed by gemm_pack, GEMM_PACK_ALIGNMENT aligned
+ * @param x the vector
+ * @param nonzeros indexes of the non zero elements of x
+ * @param count number of indexes
+ * @param y receives the m results
+ * @param epilogue bias / relu fused into the store of y
+ */
+void gemv_packed_sparse_input (int m, int k, const float *packed,
+                               const float *x, const int32_t *nonzeros,
+                               int count, float *y,
+                               gemm_epilogue epilogue);
+
+#endif //GEMM_H
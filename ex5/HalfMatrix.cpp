@@ -0,0 +1,353 @@
+#include "HalfMatrix.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HALF_X86
+#include <immintrin.h>
+#endif
+
+#define HALF_LANES 8
+
+/**
+ * rounds a float to the nearest IEEE half (ties to even)
+ * @param value float to convert
+ * @return the half bits
+ */
+uint16_t float_to_fp16 (float value) {
+  uint32_t bits;
+  std::memcpy (&bits, &value, sizeof (bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  uint32_t abs = bits & 0x7fffffff;
+  if (abs >= 0x7f800000) {
+    // inf stays inf, nan stays a (quiet) nan
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  }
+  if (abs >= 0x477ff000) {
+    // 65520 and above round past the largest half
+    return sign | 0x7c00;
+  }
+  if (abs < 0x38800000) {
+    // below 2^-14: a subnormal half, in units of 2^-24
+    if (abs < 0x33000000) {
+      return sign;
+    }
+    uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+    uint32_t shift = 126 - (abs >> 23);
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t middle = 1u << (shift - 1);
+    if (rest > middle || (rest == middle && (half & 1))) {
+      ++half;
+    }
+    return sign | half;
+  }
+  uint32_t half = (abs >> 13) - (112 << 10);
+  uint32_t rest = abs & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+    ++half;
+  }
+  return sign | half;
+}
+
+/**
+ * @param bits half bits
+ * @return the exact float value of the half
+ */
+float fp16_to_float (uint16_t bits) {
+  uint32_t sign = (uint32_t) (bits & 0x8000) << 16;
+  uint32_t exponent = (bits >> 10) & 0x1f;
+  uint32_t mantissa = bits & 0x3ff;
+  uint32_t result;
+  if (exponent == 0x1f) {
+    result = sign | 0x7f800000 | (mantissa << 13);
+  }
+  else if (exponent == 0) {
+    // zero or subnormal: mantissa * 2^-24
+    float value = (float) mantissa * 5.9604644775390625e-8f;
+    std::memcpy (&result, &value, sizeof (result));
+    result |= sign;
+  }
+  else {
+    result = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float value;
+  std::memcpy (&value, &result, sizeof (value));
+  return value;
+}
+
+/**
+ * rounds a float to the nearest bfloat16 (ties to even)
+ * @param value float to convert
+ * @return the bfloat16 bits
+ */
+uint16_t float_to_bf16 (float value) {
+  uint32_t bits;
+  std::memcpy (&bits, &value, sizeof (bits));
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    return (bits >> 16) | 0x40;
+  }
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return bits >> 16;
+}
+
+/**
+ * @param bits bfloat16 bits
+ * @return the exact float value of the bfloat16
+ */
+float bf16_to_float (uint16_t bits) {
+  uint32_t result = (uint32_t) bits << 16;
+  float value;
+  std::memcpy (&value, &result, sizeof (value));
+  return value;
+}
+
+/**
+ * portable fp16 row times float vector
+ * @param w row of 16 bit weights
+ * @param x float vector
+ * @param len length of both
+ * @return the dot product
+ */
+static float dot_fp16_generic (const uint16_t *w, const float *x, int len) {
+  float lanes[HALF_LANES] = {0};
+  int k = 0;
+  for (; k + HALF_LANES <= len; k += HALF_LANES) {
+    for (int l = 0; l < HALF_LANES; ++l) {
+      lanes[l] += fp16_to_float (w[k + l]) * x[k + l];
+    }
+  }
+  float sum = 0;
+  for (; k < len; ++k) {
+    sum += fp16_to_float (w[k]) * x[k];
+  }
+  for (int l = 0; l < HALF_LANES; ++l) {
+    sum += lanes[l];
+  }
+  return sum;
+}
+
+/**
+ * portable bf16 row times float vector
+ * @param w row of 16 bit weights
+ * @param x float vector
+ * @param len length of both
+ * @return the dot product
+ */
+static float dot_bf16_generic (const uint16_t *w, const float *x, int len) {
+  float lanes[HALF_LANES] = {0};
+  int k = 0;
+  for (; k + HALF_LANES <= len; k += HALF_LANES) {
+    for (int l = 0; l < HALF_LANES; ++l) {
+      lanes[l] += bf16_to_float (w[k + l]) * x[k + l];
+    }
+  }
+  float sum = 0;
+  for (; k < len; ++k) {
+    sum += bf16_to_float (w[k]) * x[k];
+  }
+  for (int l = 0; l < HALF_LANES; ++l) {
+    sum += lanes[l];
+  }
+  return sum;
+}
+
+#ifdef HALF_X86
+/**
+ * sums the eight lanes of a register
+ * @param v the register
+ * @return the sum
+ */
+__attribute__ ((target ("avx2")))
+static inline float horizontal_sum (__m256 v) {
+  __m128 sum = _mm_add_ps (_mm256_castps256_ps128 (v),
+                           _mm256_extractf128_ps (v, 1));
+  sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+  sum = _mm_add_ss (sum, _mm_movehdup_ps (sum));
+  return _mm_cvtss_f32 (sum);
+}
+
+/**
+ * F16C fp16 row times float vector, two independent accumulators
+ * @param w row of 16 bit weights
+ * @param x float vector
+ * @param len length of both
+ * @return the dot product
+ */
+__attribute__ ((target ("avx2,fma,f16c")))
+static float dot_fp16_avx2 (const uint16_t *w, const float *x, int len) {
+  __m256 acc0 = _mm256_setzero_ps (), acc1 = _mm256_setzero_ps ();
+  int k = 0;
+  for (; k + 2 * HALF_LANES <= len; k += 2 * HALF_LANES) {
+    __m256 w0 = _mm256_cvtph_ps (_mm_loadu_si128 ((const __m128i *) (w + k)));
+    __m256 w1 = _mm256_cvtph_ps (
+        _mm_loadu_si128 ((const __m128i *) (w + k + HALF_LANES)));
+    acc0 = _mm256_fmadd_ps (w0, _mm256_loadu_ps (x + k), acc0);
+    acc1 = _mm256_fmadd_ps (w1, _mm256_loadu_ps (x + k + HALF_LANES), acc1);
+  }
+  float sum = horizontal_sum (_mm256_add_ps (acc0, acc1));
+  for (; k < len; ++k) {
+    sum += fp16_to_float (w[k]) * x[k];
+  }
+  return sum;
+}
+
+/**
+ * AVX2 bf16 row times float vector: widening the 16 bits and shifting
+ * them to the top of a float is the whole conversion
+ * @param w row of 16 bit weights
+ * @param x float vector
+ * @param len length of both
+ * @return the dot product
+ */
+__attribute__ ((target ("avx2,fma")))
+static float dot_bf16_avx2 (const uint16_t *w, const float *x, int len) {
+  __m256 acc0 = _mm256_setzero_ps (), acc1 = _mm256_setzero_ps ();
+  int k = 0;
+  for (; k + 2 * HALF_LANES <= len; k += 2 * HALF_LANES) {
+    __m256i w0 = _mm256_cvtepu16_epi32 (
+        _mm_loadu_si128 ((const __m128i *) (w + k)));
+    __m256i w1 = _mm256_cvtepu16_epi32 (
+        _mm_loadu_si128 ((const __m128i *) (w + k + HALF_LANES)));
+    acc0 = _mm256_fmadd_ps (_mm256_castsi256_ps (_mm256_slli_epi32 (w0, 16)),
+                            _mm256_loadu_ps (x + k), acc0);
+    acc1 = _mm256_fmadd_ps (_mm256_castsi256_ps (_mm256_slli_epi32 (w1, 16)),
+                            _mm256_loadu_ps (x + k + HALF_LANES), acc1);
+  }
+  float sum = horizontal_sum (_mm256_add_ps (acc0, acc1));
+  for (; k < len; ++k) {
+    sum += bf16_to_float (w[k]) * x[k];
+  }
+  return sum;
+}
+#endif
+
+typedef float (*half_dot_kernel) (const uint16_t *, const float *, int);
+
+/**
+ * Picks the fastest fp16 dot product the cpu can run, once.
+ * @return the dot product kernel
+ */
+static half_dot_kernel select_fp16_kernel () {
+#ifdef HALF_X86
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma")
+      && __builtin_cpu_supports ("f16c")) {
+    return dot_fp16_avx2;
+  }
+#endif
+  return dot_fp16_generic;
+}
+
+/**
+ * Picks the fastest bf16 dot product the cpu can run, once.
+ * @return the dot product kernel
+ */
+static half_dot_kernel select_bf16_kernel () {
+#ifdef HALF_X86
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma")) {
+    return dot_bf16_avx2;
+  }
+#endif
+  return dot_bf16_generic;
+}
+
+/**
+ * converts the given weights
+ * @param w weights matrix or view
+ * @param format 16 bit format to store
+ */
+HalfMatrix::HalfMatrix (const MatrixView &w, HalfFormat format)
+    : _rows (w.get_rows ()), _cols (w.get_cols ()), _format (format),
+      _owned ((size_t) w.get_rows () * w.get_cols ()) {
+  for (int r = 0; r < _rows; ++r) {
+    for (int c = 0; c < _cols; ++c) {
+      _owned[(size_t) r * _cols + c] =
+          format == HALF_FP16 ? float_to_fp16 (w (r, c))
+                              : float_to_bf16 (w (r, c));
+    }
+  }
+  _data = _owned.data ();
+}
+
+/**
+ * view over existing 16 bit elements, which must outlive the matrix
+ * @param rows num of rows
+ * @param cols num of cols
+ * @param format format of the elements
+ * @param data rows * cols elements, stored row by row
+ */
+HalfMatrix::HalfMatrix (int rows, int cols, HalfFormat format,
+                        const uint16_t *data)
+    : _rows (rows), _cols (cols), _format (format), _data (data) {
+}
+
+/**
+ *
+ * @return num of rows of the weights
+ */
+int HalfMatrix::get_rows () const {
+  return _rows;
+}
+
+/**
+ *
+ * @return num of cols of the weights
+ */
+int HalfMatrix::get_cols () const {
+  return _cols;
+}
+
+/**
+ *
+ * @return format of the elements
+ */
+HalfFormat HalfMatrix::get_format () const {
+  return _format;
+}
+
+/**
+ *
+ * @return first element, elements are stored row by row
+ */
+const uint16_t *HalfMatrix::data () const {
+  return _data;
+}
+
+/**
+ * out = W * in for n inputs, with the bias / relu epilogue applied
+ * @param in cols x n inputs, stored row by row (one input per column)
+ * @param n number of inputs
+ * @param out receives the rows x n outputs, stored row by row
+ * @param epilogue bias / relu applied on every output
+ */
+void HalfMatrix::multiply (const float *in, int n, float *out,
+                           gemm_epilogue epilogue) const {
+  static const half_dot_kernel dot_fp16 = select_fp16_kernel ();
+  static const half_dot_kernel dot_bf16 = select_bf16_kernel ();
+  half_dot_kernel dot = _format == HALF_FP16 ? dot_fp16 : dot_bf16;
+  // every input as a contiguous vector, reused by the products of the thread
+  static thread_local std::vector<float> inputs;
+  const float *vectors = in;
+  if (n > 1) {
+    inputs.resize ((size_t) n * _cols);
+    for (int k = 0; k < _cols; ++k) {
+      for (int j = 0; j < n; ++j) {
+        inputs[(size_t) j * _cols + k] = in[(size_t) k * n + j];
+      }
+    }
+    vectors = inputs.data ();
+  }
+  for (int r = 0; r < _rows; ++r) {
+    const uint16_t *row = _data + (size_t) r * _cols;
+    for (int j = 0; j < n; ++j) {
+      float value = dot (row, vectors + (size_t) j * _cols, _cols);
+      if (epilogue.bias != nullptr) {
+        value += epilogue.bias[r];
+      }
+      if (epilogue.relu && value < 0) {
+        value = 0;
+      }
+      out[r * n + j] = value;
+    }
+  }
+}
@@ -0,0 +1,120 @@
+// HalfMatrix.h
+#ifndef HALFMATRIX_H
+#define HALFMATRIX_H
+
+#include "Gemm.h"
+#include "MatrixView.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @enum HalfFormat
+ * @brief 16 bit float formats: IEEE half precision, or bfloat16 (the top
+ *        half of a float).
+ */
+enum HalfFormat
+{
+    HALF_FP16,
+    HALF_BF16
+};
+
+/**
+ * rounds a float to the nearest IEEE half (ties to even)
+ * @param value float to convert
+ * @return the half bits
+ */
+uint16_t float_to_fp16 (float value);
+
+/**
+ * @param bits half bits
+ * @return the exact float value of the half
+ */
+float fp16_to_float (uint16_t bits);
+
+/**
+ * rounds a float to the nearest bfloat16 (ties to even)
+ * @param value float to convert
+ * @return the bfloat16 bits
+ */
+uint16_t float_to_bf16 (float value);
+
+/**
+ * @param bits bfloat16 bits
+ * @return the exact float value of the bfloat16
+ */
+float bf16_to_float (uint16_t bits);
+
+/**
+ * A weight matrix stored as 16 bit floats, row by row. Products convert
+ * the weights to float in the inner loop (F16C for fp16, a shift for
+ * bf16) and accumulate in float, so they read half the bytes of a float
+ * matrix for almost the same accuracy.
+ * The matrix either owns its elements (converted from a float matrix) or
+ * is a view over existing ones (e.g. a mapped model bundle).
+ */
+class HalfMatrix {
+
+ private:
+  int _rows, _cols;
+  HalfFormat _format;
+  std::vector<uint16_t> _owned;
+  const uint16_t *_data;
+
+ public:
+
+  /**
+   * converts the given weights
+   * @param w weights matrix or view
+   * @param format 16 bit format to store
+   */
+  HalfMatrix (const MatrixView &w, HalfFormat format);
+
+  /**
+   * view over existing 16 bit elements, which must outlive the matrix
+   * @param rows num of rows
+   * @param cols num of cols
+   * @param format format of the elements
+   * @param data rows * cols elements, stored row by row
+   */
+  HalfMatrix (int rows, int cols, HalfFormat format, const uint16_t *data);
+
+  HalfMatrix (const HalfMatrix &) = delete;
+  HalfMatrix &operator= (const HalfMatrix &) = delete;
+
+  /**
+   *
+   * @return num of rows of the weights
+   */
+  int get_rows () const;
+
+  /**
+   *
+   * @return num of cols of the weights
+   */
+  int get_cols () const;
+
+  /**
+   *
+   * @return format of the elements
+   */
+  HalfFormat get_format () const;
+
+  /**
+   *
+   * @return first element, elements are stored row by row
+   */
+  const uint16_t *data () const;
+
+  /**
+   * out = W * in for n inputs, with the bias / relu epilogue applied
+   * @param in cols x n inputs, stored row by row (one input per column)
+   * @param n number of inputs
+   * @param out receives the rows x n outputs, stored row by row
+   * @param epilogue bias / relu applied on every output
+   */
+  void multiply (const float *in, int n, float *out,
+                 gemm_epilogue epilogue) const;
+};
+
+#endif //HALFMATRIX_H
@@ -0,0 +1,135 @@
+#include "ImagePrefetcher.h"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Reads a binary file of exactly count floats into data with a single
+ * open, fstat and read (no seeking).
+ * @param path path of the file
+ * @param data receives the floats
+ * @param count expected number of floats in the file
+ * @return true on success
+ */
+bool read_image_file (const std::string &path, float *data, size_t count) {
+  int fd = open (path.c_str (), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  size_t size = count * sizeof (float);
+  struct stat st;
+  bool valid = fstat (fd, &st) == 0 && S_ISREG (st.st_mode)
+               && (size_t) st.st_size == size;
+  char *dst = reinterpret_cast<char *> (data);
+  size_t done = 0;
+  while (valid && done < size) {
+    ssize_t n = read (fd, dst + done, size - done);
+    if (n <= 0) {
+      valid = false;
+    } else {
+      done += n;
+    }
+  }
+  close (fd);
+  return valid;
+}
+
+/**
+ * constructor of class, starts reading the first batch
+ * @param paths paths of the images, must outlive the prefetcher
+ * @param img_size number of floats in every image
+ * @param batch_size largest number of images in a batch
+ * @param readers threads reading the files of a batch
+ */
+ImagePrefetcher::ImagePrefetcher (const std::vector<std::string> &paths,
+                                  int img_size, int batch_size, int readers)
+    : _paths (paths), _img_size (img_size),
+      _batch_size (std::max (1, batch_size)), _next (0), _stop (false),
+      _readers (std::max (1, readers)) {
+  for (slot &s : _slots) {
+    s.data.resize ((size_t) _batch_size * _img_size);
+    s.loaded.resize (_batch_size);
+  }
+  _thread = std::thread (&ImagePrefetcher::prefetch, this);
+}
+
+/**
+ * destructor of class, stops the background thread
+ */
+ImagePrefetcher::~ImagePrefetcher () {
+  {
+    std::lock_guard<std::mutex> lock (_mutex);
+    _stop = true;
+  }
+  _changed.notify_all ();
+  _thread.join ();
+}
+
+/**
+ *
+ * @return number of batches of the paths
+ */
+int ImagePrefetcher::batch_count () const {
+  return ((int) _paths.size () + _batch_size - 1) / _batch_size;
+}
+
+/**
+ * background thread, batch i is read into buffer i % 2 once the caller
+ * released what that buffer held
+ */
+void ImagePrefetcher::prefetch () {
+  for (int b = 0; b < batch_count (); ++b) {
+    slot &s = _slots[b % 2];
+    {
+      std::unique_lock<std::mutex> lock (_mutex);
+      _changed.wait (lock, [&] { return _stop || s.state == SLOT_FREE; });
+      if (_stop) {
+        return;
+      }
+    }
+    s.start = b * _batch_size;
+    s.count = std::min (_batch_size, (int) _paths.size () - s.start);
+    _readers.parallel_for (s.count, 16, [&] (int, int begin, int end) {
+      for (int i = begin; i < end; ++i) {
+        s.loaded[i] = read_image_file (_paths[s.start + i],
+                                       s.data.data ()
+                                       + (size_t) i * _img_size,
+                                       _img_size);
+      }
+    });
+    {
+      std::lock_guard<std::mutex> lock (_mutex);
+      s.state = SLOT_READY;
+    }
+    _changed.notify_all ();
+  }
+}
+
+/**
+ * Gives the next batch, waiting for it if it is not read yet. The
+ * previous batch is released, its buffer is reused for prefetching.
+ * @param batch receives the batch
+ * @return false when every batch was given
+ */
+bool ImagePrefetcher::next (image_batch &batch) {
+  std::unique_lock<std::mutex> lock (_mutex);
+  if (_next > 0 && _slots[(_next - 1) % 2].state == SLOT_IN_USE) {
+    _slots[(_next - 1) % 2].state = SLOT_FREE;
+    _changed.notify_all ();
+  }
+  if (_next >= batch_count ()) {
+    return false;
+  }
+  slot &s = _slots[_next % 2];
+  _changed.wait (lock, [&] { return s.state == SLOT_READY; });
+  s.state = SLOT_IN_USE;
+  ++_next;
+  batch.data = s.data.data ();
+  batch.loaded = s.loaded.data ();
+  batch.start = s.start;
+  batch.count = s.count;
+  return true;
+}
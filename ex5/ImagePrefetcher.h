@@ -0,0 +1,113 @@
+// ImagePrefetcher.h
+#ifndef IMAGEPREFETCHER_H
+#define IMAGEPREFETCHER_H
+
+#include "ThreadPool.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// threads reading the files of a batch, more requests in flight hide the
+// latency of a cold disk
+#define PREFETCH_READERS 4
+
+/**
+ * Reads a binary file of exactly count floats into data with a single
+ * open, fstat and read (no seeking).
+ * @param path path of the file
+ * @param data receives the floats
+ * @param count expected number of floats in the file
+ * @return true on success, false if the file can not be read or its size
+ *         is not count floats
+ */
+bool read_image_file (const std::string &path, float *data, size_t count);
+
+/**
+ * @struct image_batch
+ * @brief A batch of images given by ImagePrefetcher::next.
+ * @var data - the images, one flattened image per row
+ * @var loaded - loaded[i] is false if image i could not be read
+ * @var start - index of the first image of the batch in the paths
+ * @var count - number of images in the batch
+ */
+typedef struct image_batch {
+  float *data;
+  const char *loaded;
+  int start;
+  int count;
+} image_batch;
+
+/**
+ * Loads a list of image files batch after batch on a background thread.
+ * There are two batch buffers: while the caller works on one batch, the
+ * next one is read into the other buffer, so disk latency overlaps the
+ * caller's compute instead of stalling it.
+ */
+class ImagePrefetcher {
+
+ private:
+  enum slot_state { SLOT_FREE, SLOT_READY, SLOT_IN_USE };
+
+  struct slot {
+    std::vector<float> data;
+    std::vector<char> loaded;
+    int start = 0;
+    int count = 0;
+    slot_state state = SLOT_FREE;
+  };
+
+  const std::vector<std::string> &_paths;
+  int _img_size, _batch_size;
+  slot _slots[2];
+  // index of the next batch the caller gets
+  int _next;
+  bool _stop;
+  std::mutex _mutex;
+  std::condition_variable _changed;
+  ThreadPool _readers;
+  std::thread _thread;
+
+  /**
+   * background thread, fills the free buffer with the next batch
+   */
+  void prefetch ();
+
+  /**
+   *
+   * @return number of batches of the paths
+   */
+  int batch_count () const;
+
+ public:
+
+  /**
+   * constructor of class, starts reading the first batch
+   * @param paths paths of the images, must outlive the prefetcher
+   * @param img_size number of floats in every image
+   * @param batch_size largest number of images in a batch
+   * @param readers threads reading the files of a batch
+   */
+  ImagePrefetcher (const std::vector<std::string> &paths, int img_size,
+                   int batch_size, int readers = PREFETCH_READERS);
+
+  ImagePrefetcher (const ImagePrefetcher &) = delete;
+  ImagePrefetcher &operator= (const ImagePrefetcher &) = delete;
+
+  /**
+   * destructor of class, stops the background thread
+   */
+  ~ImagePrefetcher ();
+
+  /**
+   * Gives the next batch, waiting for it if it is not read yet. The
+   * previous batch is released, its buffer is reused for prefetching.
+   * @param batch receives the batch
+   * @return false when every batch was given
+   */
+  bool next (image_batch &batch);
+};
+
+#endif //IMAGEPREFETCHER_H
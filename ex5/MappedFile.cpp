@@ -0,0 +1,82 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+/**
+ * maps the whole file, check is_open () for success
+ * @param path path of the file to map
+ */
+MappedFile::MappedFile (const std::string &path) : MappedFile () {
+  int fd = open (path.c_str (), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode) && st.st_size > 0) {
+    void *data = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      _data = data;
+      _size = st.st_size;
+    }
+  }
+  // the mapping stays valid after the descriptor is closed
+  close (fd);
+}
+
+/**
+ * move constructor, m is left not open
+ * @param m mapping to move
+ */
+MappedFile::MappedFile (MappedFile &&m) noexcept
+    : _data (m._data), _size (m._size) {
+  m._data = nullptr;
+  m._size = 0;
+}
+
+/**
+ * move assignment, the current mapping (if any) is released
+ * @param m mapping to move
+ * @return the obj
+ */
+MappedFile &MappedFile::operator= (MappedFile &&m) noexcept {
+  std::swap (_data, m._data);
+  std::swap (_size, m._size);
+  return *this;
+}
+
+/**
+ * destructor of class, unmaps the file
+ */
+MappedFile::~MappedFile () {
+  if (_data != nullptr) {
+    munmap (_data, _size);
+  }
+}
+
+/**
+ *
+ * @return true if the file was mapped
+ */
+bool MappedFile::is_open () const {
+  return _data != nullptr;
+}
+
+/**
+ *
+ * @return size of the mapped file in bytes
+ */
+size_t MappedFile::size () const {
+  return _size;
+}
+
+/**
+ *
+ * @return first byte of the mapped file (read only)
+ */
+const char *MappedFile::data () const {
+  return static_cast<const char *> (_data);
+}
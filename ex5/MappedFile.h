@@ -0,0 +1,73 @@
+// MappedFile.h
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * A file mapped read-only into memory. Nothing can write to the pages, so
+ * processes that map the same file always share its physical pages. The
+ * mapping lives as long as the object.
+ */
+class MappedFile {
+
+ private:
+  void *_data;
+  size_t _size;
+
+ public:
+
+  /**
+   * maps the whole file, check is_open () for success
+   * @param path path of the file to map
+   */
+  explicit MappedFile (const std::string &path);
+
+  /**
+   * empty (not open) mapping
+   */
+  MappedFile () : _data (nullptr), _size (0)
+  {}
+
+  MappedFile (const MappedFile &) = delete;
+  MappedFile &operator= (const MappedFile &) = delete;
+
+  /**
+   * move constructor, m is left not open
+   * @param m mapping to move
+   */
+  MappedFile (MappedFile &&m) noexcept;
+
+  /**
+   * move assignment, the current mapping (if any) is released
+   * @param m mapping to move
+   * @return the obj
+   */
+  MappedFile &operator= (MappedFile &&m) noexcept;
+
+  /**
+   * destructor of class, unmaps the file
+   */
+  ~MappedFile ();
+
+  /**
+   *
+   * @return true if the file was mapped
+   */
+  bool is_open () const;
+
+  /**
+   *
+   * @return size of the mapped file in bytes
+   */
+  size_t size () const;
+
+  /**
+   *
+   * @return first byte of the mapped file (read only)
+   */
+  const char *data () const;
+};
+
+#endif //MAPPEDFILE_H
@@ -1,50 +1,153 @@
 #include "Matrix.h"
+#include "MatrixView.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// rows and cols of the tiles of a transposed copy
+#define MATRIX_TILE 16
 
 /**
  * constructor of class matrix
  * @param rows num of rows
  * @param cols num of cols
  */
-Matrix::Matrix (int rows, int cols) : _matrix_dims{rows, cols} {
-  if (rows <= 0 || cols <= 0) {
+Matrix::Matrix (int rows, int cols) : Matrix (rows, cols, cols) {
+}
+
+/**
+ * constructor of a matrix with padded rows, the padding is zero
+ * @param rows num of rows
+ * @param cols num of cols
+ * @param ld floats from a row to the next, at least cols
+ */
+Matrix::Matrix (int rows, int cols, int ld) : _matrix_dims{rows, cols} {
+  allocate (rows, cols, ld);
+  std::memset (_matrix, 0, (size_t) rows * ld * sizeof (float));
+}
+
+/**
+ * constructor of a view over existing elements (e.g. a mapped file),
+ * the matrix does not own them and never frees them
+ * @param rows num of rows
+ * @param cols num of cols
+ * @param data the elements, stored row by row
+ * @param ld floats from a row to the next, 0 for cols
+ */
+Matrix::Matrix (int rows, int cols, float *data, int ld)
+    : _matrix_dims{rows, cols}, _ld (ld == 0 ? cols : ld), _matrix (data) {
+  if (rows <= 0 || cols <= 0 || data == nullptr || _ld < cols) {
     std::cerr << "Error: the cols and rows must be a positive number"
               << std::endl;
     exit (EXIT_FAILURE);
   }
-  _matrix = new (std::nothrow) float[_matrix_dims.cols * _matrix_dims.rows]{0};
-  if (_matrix == nullptr) {
+}
+
+/**
+ * allocates uninitialized elements aligned to MATRIX_ALIGNMENT, exits
+ * (code == 1) on invalid dims or allocation failure
+ * @param rows num of rows
+ * @param cols num of cols
+ * @param ld floats from a row to the next, at least cols
+ */
+void Matrix::allocate (int rows, int cols, int ld) {
+  if (rows <= 0 || cols <= 0 || ld < cols) {
+    std::cerr << "Error: the cols and rows must be a positive number"
+              << std::endl;
+    exit (EXIT_FAILURE);
+  }
+  _storage = new (std::nothrow) float[(size_t) rows * ld
+                                      + MATRIX_ALIGNMENT / sizeof (float)];
+  if (_storage == nullptr) {
     std::cerr << "Error: allocation failed" << std::endl;
     exit (EXIT_FAILURE);
   }
+  uintptr_t address = (uintptr_t) _storage;
+  address = (address + MATRIX_ALIGNMENT - 1)
+            / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+  _matrix = (float *) address;
+  _ld = ld;
 }
 
 /**
- * copy constructor
- * @param m matrix to copy
+ * frees the owned elements, if any
  */
-Matrix::Matrix (const Matrix &m) {
-  if (this == &m) {
+void Matrix::release () {
+  delete[] _storage;
+  _storage = nullptr;
+  _matrix = nullptr;
+}
+
+/**
+ * constructor from a view, copies its elements without padding. A
+ * transposed view is copied in MATRIX_TILE square tiles
+ * @param v view to copy
+ */
+Matrix::Matrix (const MatrixView &v)
+    : _matrix_dims{v.get_rows (), v.get_cols ()} {
+  allocate (v.get_rows (), v.get_cols (), v.get_cols ());
+  const float *in = v.data ();
+  if (!v.is_transposed ()) {
+    for (int r = 0; r < _matrix_dims.rows; ++r) {
+      std::memcpy (_matrix + (size_t) r * _ld, in + (size_t) r * v.get_ld (),
+                   _matrix_dims.cols * sizeof (float));
+    }
     return;
   }
-  this->_matrix_dims.rows = m.get_rows ();
-  this->_matrix_dims.cols = m.get_cols ();
-  this->_matrix = new (std::nothrow) float[_matrix_dims.cols
-                                           * _matrix_dims.rows]{0};
-  if (_matrix == nullptr) {
-    std::cerr << "Error: allocation failed" << std::endl;
-    exit (EXIT_FAILURE);
+  for (int r0 = 0; r0 < _matrix_dims.rows; r0 += MATRIX_TILE) {
+    int r1 = std::min (r0 + MATRIX_TILE, _matrix_dims.rows);
+    for (int c0 = 0; c0 < _matrix_dims.cols; c0 += MATRIX_TILE) {
+      int c1 = std::min (c0 + MATRIX_TILE, _matrix_dims.cols);
+      for (int r = r0; r < r1; ++r) {
+        for (int c = c0; c < c1; ++c) {
+          _matrix[(size_t) r * _ld + c] = in[(size_t) c * v.get_ld () + r];
+        }
+      }
+    }
   }
-  int end = m.get_rows () * m.get_cols ();
-  for (int i = 0; i < end; ++i) {
-    (*this)[i] = m[i];
+}
+
+/**
+ * copy constructor, the copy has the leading dimension of m. Every element
+ * is written once: the rows are copied and only the padding is zeroed
+ * @param m matrix to copy
+ */
+Matrix::Matrix (const Matrix &m) : _matrix_dims (m._matrix_dims) {
+  allocate (m.get_rows (), m.get_cols (), m.get_ld ());
+  if (_ld == _matrix_dims.cols) {
+    std::memcpy (_matrix, m._matrix,
+                 (size_t) _matrix_dims.rows * _ld * sizeof (float));
+    return;
   }
+  for (int r = 0; r < _matrix_dims.rows; ++r) {
+    float *row = _matrix + (size_t) r * _ld;
+    std::memcpy (row, m._matrix + (size_t) r * _ld,
+                 _matrix_dims.cols * sizeof (float));
+    std::memset (row + _matrix_dims.cols, 0,
+                 (_ld - _matrix_dims.cols) * sizeof (float));
+  }
+}
+
+/**
+ * move constructor, takes the elements of m without copying them.
+ * m is left as an empty matrix
+ * @param m matrix to move
+ */
+Matrix::Matrix (Matrix &&m) noexcept
+    : _matrix_dims (m._matrix_dims), _ld (m._ld), _matrix (m._matrix),
+      _storage (m._storage) {
+  m._matrix_dims = {0, 0};
+  m._ld = 0;
+  m._matrix = nullptr;
+  m._storage = nullptr;
 }
 
 /**
  * destructor of class
  */
 Matrix::~Matrix () {
-  delete[] _matrix;
+  release ();
 }
 
 /**
@@ -65,27 +168,82 @@ int Matrix::get_cols () const {
 
 /**
  *
+ * @return floats from a row to the next in data ()
+ */
+int Matrix::get_ld () const {
+  return _ld;
+}
+
+/**
+ *
+ * @return true if the rows follow each other without padding
+ */
+bool Matrix::is_contiguous () const {
+  return _ld == _matrix_dims.cols || _matrix_dims.rows <= 1;
+}
+
+/**
+ * @param cols num of cols
+ * @return the smallest leading dimension of at least cols floats that
+ * keeps every row on a MATRIX_ALIGNMENT boundary
+ */
+int Matrix::padded_ld (int cols) {
+  const int lanes = MATRIX_ALIGNMENT / sizeof (float);
+  return (cols + lanes - 1) / lanes * lanes;
+}
+
+/**
+ *
+ * @return true if the matrix frees its elements, false for a view
+ */
+bool Matrix::owns_data () const {
+  return _storage != nullptr;
+}
+
+/**
+ *
+ * @return pointer to the first element, elements are stored row by row,
+ * get_ld () floats apart
+ */
+float *Matrix::data () {
+  return _matrix;
+}
+
+/**
+ *
+ * @return pointer to the first element, elements are stored row by row,
+ * get_ld () floats apart
+ */
+const float *Matrix::data () const {
+  return _matrix;
+}
+
+/**
+ * the transpose is stored without padding, in a single copy of a
+ * transposed view
  * @return transpose matrix
  */
 Matrix &Matrix::transpose () {
-  Matrix new_matrix = Matrix (_matrix_dims.cols, _matrix_dims.rows);
-  for (int r = 0; r < _matrix_dims.rows; ++r) {
-    for (int c = 0; c < _matrix_dims.cols; ++c) {
-      new_matrix[c * _matrix_dims.rows + r] =
-          _matrix[r * _matrix_dims.cols + c];
-    }
-  }
-  *this = new_matrix;
+  *this = Matrix (MatrixView (*this).transpose ());
   return (*this);
 }
 
 /**
- * change the matrix to: rows = rows * cols, and cols = 1
+ * change the matrix to: rows = rows * cols, and cols = 1. Padded rows
+ * are moved together first (row r only moves down, over rows before it)
  * @return the matrix as vector
  */
 Matrix &Matrix::vectorize () {
+  if (!is_contiguous ()) {
+    for (int r = 1; r < _matrix_dims.rows; ++r) {
+      std::memmove (_matrix + (size_t) r * _matrix_dims.cols,
+                    _matrix + (size_t) r * _ld,
+                    _matrix_dims.cols * sizeof (float));
+    }
+  }
   _matrix_dims.rows = _matrix_dims.cols * _matrix_dims.rows;
   _matrix_dims.cols = 1;
+  _ld = 1;
   return *this;
 }
 
@@ -97,7 +255,7 @@ Matrix &Matrix::vectorize () {
 void Matrix::plain_print () {
   for (int r = 0; r < _matrix_dims.rows; ++r) {
     for (int c = 0; c < _matrix_dims.cols; ++c) {
-      std::cout << _matrix[r * _matrix_dims.cols + c] << " ";
+      std::cout << _matrix[r * _ld + c] << " ";
     }
     std::cout << std::endl;
   }
@@ -105,22 +263,45 @@ void Matrix::plain_print () {
 }
 
 /**
- *
+ * element-wise multiplication, computed lazily
+ * @param m matrix to multi with;
+ * @return dot expression;
+ */
+MatrixExpr<expr_product<expr_leaf, expr_leaf>> Matrix::dot (const Matrix &m)
+const & {
+  return MatrixExpr<expr_leaf> (to_expr (*this)).dot (m);
+}
+
+/**
+ * element-wise multiplication by a view, computed lazily
+ * @param m view to multi with;
+ * @return dot expression;
+ */
+MatrixExpr<expr_product<expr_leaf, expr_leaf>> Matrix::dot (
+    const MatrixView &m) const {
+  return MatrixExpr<expr_leaf> (to_expr (*this)).dot (m);
+}
+
+/**
+ * dot of a temporary matrix, the result reuses its elements (a view is
+ * copied, its elements are not written)
  * @param m matrix to multi with;
  * @return dot matrix;
  */
-Matrix Matrix::dot (const Matrix &m) {
+Matrix Matrix::dot (const Matrix &m) && {
+  if (!owns_data ()) {
+    return Matrix (*this).dot (m);
+  }
   if (m.get_cols () != _matrix_dims.cols
       || m.get_rows () != _matrix_dims.rows) {
     std::cerr << "Error: cols and rows of the new matrix must be equal to"
                  " the old one" << std::endl;
     exit (EXIT_FAILURE);
   }
-  Matrix to_return (*this);
   for (int i = 0; i < this->get_rows () * this->get_cols (); ++i) {
-    to_return[i] = _matrix[i] * m[i];
+    (*this)[i] *= m[i];
   }
-  return to_return;
+  return std::move (*this);
 }
 
 /**
@@ -130,7 +311,7 @@ Matrix Matrix::dot (const Matrix &m) {
 float Matrix::norm () const {
   float sum = 0;
   for (int i = 0; i < _matrix_dims.rows * _matrix_dims.cols; ++i) {
-    sum += powf (_matrix[i], 2);
+    sum += powf ((*this)[i], 2);
   }
   return sqrtf (sum);
 }
@@ -167,26 +348,41 @@ void read_binary_file (std::istream &is, Matrix &m) {
 //Operators
 
 /**
- * add the given matrix the the obj
+ * add the given matrix the the obj, computed lazily
+ * @param m matrix to add
+ * @return the sum expression
+ */
+MatrixExpr<expr_sum<expr_leaf, expr_leaf>> Matrix::operator+ (const Matrix &m)
+const & {
+  return MatrixExpr<expr_leaf> (to_expr (*this)) + m;
+}
+
+/**
+ * add the given view to the obj, computed lazily
+ * @param m view to add
+ * @return the sum expression
+ */
+MatrixExpr<expr_sum<expr_leaf, expr_leaf>> Matrix::operator+ (
+    const MatrixView &m) const {
+  return MatrixExpr<expr_leaf> (to_expr (*this)) + m;
+}
+
+/**
+ * add the given matrix to a temporary matrix, the result reuses its
+ * elements (a view is copied, its elements are not written)
  * @param m matrix to add
  * @return the new matrix
  */
-Matrix Matrix::operator+ (const Matrix &m) {
-  if (m.get_cols () != _matrix_dims.cols
-      || m.get_rows () != _matrix_dims.rows) {
-    std::cerr << "Error: cols and rows of the new matrix must be equal to"
-                 " the old one" << std::endl;
-    exit (EXIT_FAILURE);
+Matrix Matrix::operator+ (const Matrix &m) && {
+  if (!owns_data ()) {
+    return Matrix (*this) + m;
   }
-  Matrix to_return (*this);
-  for (int i = 0; i < this->get_rows () * this->get_cols (); ++i) {
-    to_return[i] = _matrix[i] + m[i];
-  }
-  return to_return;
+  *this += m;
+  return std::move (*this);
 }
 
 /**
- * copy the given matrix the the obj
+ * copy the given matrix the the obj, with the leading dimension of m
  * @param m matrix to copy
  * @return the new matrix
  */
@@ -194,55 +390,56 @@ Matrix &Matrix::operator= (const Matrix &m) {
   if (this == &m) {
     return *this;
   }
-  delete[] this->_matrix;
-  _matrix_dims.rows = m.get_rows ();
-  _matrix_dims.cols = m.get_cols ();
-  _matrix = new (std::nothrow) float[m.get_rows () * m.get_cols ()]{0.0};
-  if (_matrix == nullptr) {
-    std::cerr << "Error: allocation failed" << std::endl;
-    exit (EXIT_FAILURE);
-  }
-  for (int i = 0; i < m.get_rows () * m.get_cols (); ++i) {
-    (*this)[i] = m[i];
-  }
+  return *this = Matrix (m);
+}
+
+/**
+ * move the given matrix to the obj, without copying its elements
+ * @param m matrix to move
+ * @return the obj
+ */
+Matrix &Matrix::operator= (Matrix &&m) noexcept {
+  std::swap (_matrix_dims, m._matrix_dims);
+  std::swap (_ld, m._ld);
+  std::swap (_matrix, m._matrix);
+  std::swap (_storage, m._storage);
   return *this;
 }
 
 /**
- * Multiplies the 2 matrix according to the rules of the matrix multi
+ * Multiplies the 2 matrix according to the rules of the matrix multi,
+ * as views of the two (a few vectors run the matrix-vector kernels)
  * @param m matrix to multi
  * @return the new matrix
  */
 Matrix Matrix::operator* (const Matrix &m) const {
-  if (_matrix_dims.cols != m.get_rows ()) {
-    std::cerr << "Error: rows of the new matrix must be equal to"
-                 " the cols of the old one" << std::endl;
-    exit (EXIT_FAILURE);
-  }
-  Matrix new_matrix = Matrix (_matrix_dims.rows, m.get_cols ());
-  for (int r = 0; r < _matrix_dims.rows; ++r) {
-    for (int c = 0; c < m.get_cols (); ++c) {
-      for (int k = 0; k < _matrix_dims.cols; ++k) {
-        float a = (*this) (r, k);
-        float b = m (k, c);
-        new_matrix (r, c) += (a * b);
-      }
-    }
-  }
-  return new_matrix;
+  return MatrixView (*this) * MatrixView (m);
 }
 
 /**
- * Multiples between the matrix and scalar with the scalar on the left
+ * Multiples between the matrix and scalar with the scalar on the left,
+ * computed lazily
+ * @param s scalar
+ * @return the scaled expression
+ */
+MatrixExpr<expr_scaled<expr_leaf>> Matrix::operator* (float s) const & {
+  return MatrixExpr<expr_leaf> (to_expr (*this)) * s;
+}
+
+/**
+ * Multiples between a temporary matrix and scalar, the result reuses its
+ * elements (a view is copied, its elements are not written)
  * @param s scalar
  * @return the new matrix
  */
-Matrix Matrix::operator* (float s) {
-  Matrix to_return (*this);
+Matrix Matrix::operator* (float s) && {
+  if (!owns_data ()) {
+    return Matrix (*this) * s;
+  }
   for (int i = 0; i < this->get_rows () * this->get_cols (); ++i) {
-    to_return[i] = _matrix[i] * s;
+    (*this)[i] *= s;
   }
-  return to_return;
+  return std::move (*this);
 }
 
 /**
@@ -274,7 +471,7 @@ float Matrix::operator() (int i, int j) const {
     std::cerr << "Error: index out of range" << std::endl;
     exit (EXIT_FAILURE);
   }
-  return _matrix[i * _matrix_dims.cols + j];
+  return _matrix[i * _ld + j];
 }
 
 /**
@@ -288,7 +485,7 @@ float &Matrix::operator() (int i, int j) {
     std::cerr << "Error: index out of range" << std::endl;
     exit (EXIT_FAILURE);
   }
-  return _matrix[i * _matrix_dims.cols + j];
+  return _matrix[i * _ld + j];
 }
 
 /**
@@ -297,7 +494,10 @@ float &Matrix::operator() (int i, int j) {
  * @return - the index element in the matrix
  */
 float Matrix::operator[] (int index) const {
-  return _matrix[index];
+  if (_ld == _matrix_dims.cols) {
+    return _matrix[index];
+  }
+  return _matrix[index / _matrix_dims.cols * _ld + index % _matrix_dims.cols];
 }
 
 /**
@@ -306,7 +506,10 @@ float Matrix::operator[] (int index) const {
  * @return - reference to the index element in the matrix
  */
 float &Matrix::operator[] (int index) {
-  return _matrix[index];
+  if (_ld == _matrix_dims.cols) {
+    return _matrix[index];
+  }
+  return _matrix[index / _matrix_dims.cols * _ld + index % _matrix_dims.cols];
 }
 
 /**
@@ -1,7 +1,13 @@
 // Matrix.h
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <utility>
+#include "MatrixExpr.h"
 #define TO_PRINT 0.1
+// alignment in bytes of the first element of every owned matrix (a cache
+// line), padded rows (see Matrix::padded_ld) start on one too
+#define MATRIX_ALIGNMENT 64
 
 #ifndef MATRIX_H
 #define MATRIX_H
@@ -22,7 +28,37 @@ class Matrix {
 
  private:
   matrix_dims _matrix_dims{};
-  float *_matrix;
+  // floats from a row to the next, cols unless the rows are padded
+  int _ld = 0;
+  // first element, MATRIX_ALIGNMENT aligned inside _storage when owned
+  float *_matrix = nullptr;
+  // the owned allocation, nullptr for a view
+  float *_storage = nullptr;
+
+  /**
+   * allocates uninitialized elements aligned to MATRIX_ALIGNMENT into
+   * _storage and _matrix (the old ones are not freed), exits (code == 1)
+   * on invalid dims or allocation failure
+   * @param rows num of rows
+   * @param cols num of cols
+   * @param ld floats from a row to the next, at least cols
+   */
+  void allocate (int rows, int cols, int ld);
+
+  /**
+   * frees the owned elements, if any
+   */
+  void release ();
+
+  /**
+   * computes an expression of the dims of the obj into its elements. An
+   * expression that reads them other than as stored (transposed, or at
+   * another offset or row stride) is computed into a new matrix first, which an owning obj without padding then takes, and a view or
+   * a padded obj copies
+   * @param node root node of the expression
+   */
+  template<class E>
+  void evaluate (const E &node);
 
  public:
 
@@ -40,11 +76,56 @@ class Matrix {
   {}
 
   /**
-   * copy constructor
+   * constructor of a matrix with padded rows: row r starts ld floats
+   * after row r - 1, so with ld = padded_ld (cols) every row starts on a
+   * cache line and can be read with aligned vector loads up to ld floats
+   * (the padding is zero). Element indexing skips the padding.
+   * @param rows num of rows
+   * @param cols num of cols
+   * @param ld floats from a row to the next, at least cols
+   */
+  Matrix (int rows, int cols, int ld);
+
+  /**
+   * constructor of a view over existing elements (e.g. a mapped file),
+   * the matrix does not own them and never frees them. Copies of a view
+   * own their elements.
+   * @param rows num of rows
+   * @param cols num of cols
+   * @param data the elements, stored row by row
+   * @param ld floats from a row to the next, 0 for cols
+   */
+  Matrix (int rows, int cols, float *data, int ld = 0);
+
+  /**
+   * constructor from a view (see MatrixView.h), copies its elements
+   * without padding. A transposed view is copied in tiles, so the reads
+   * and the writes both stay in a few cache lines.
+   * @param v view to copy
+   */
+  explicit Matrix (const MatrixView &v);
+
+  /**
+   * copy constructor, the copy has the leading dimension of m
    * @param m matrix to copy
    */
   Matrix (const Matrix &m);
 
+  /**
+   * move constructor, takes the elements of m without copying them.
+   * m is left as an empty matrix
+   * @param m matrix to move
+   */
+  Matrix (Matrix &&m) noexcept;
+
+  /**
+   * constructor from an element-wise expression (e.g. s * (a + b)),
+   * computes it in a single pass
+   * @param e expression to compute
+   */
+  template<class E>
+  Matrix (const MatrixExpr<E> &e);
+
   /**
    * destructor of class
    */
@@ -64,12 +145,55 @@ class Matrix {
 
   /**
    *
+   * @return floats from a row to the next in data ()
+   */
+  int get_ld () const;
+
+  /**
+   *
+   * @return true if the rows follow each other without padding, so the
+   * rows * cols elements are contiguous in data ()
+   */
+  bool is_contiguous () const;
+
+  /**
+   * @param cols num of cols
+   * @return the smallest leading dimension of at least cols floats that
+   * keeps every row on a MATRIX_ALIGNMENT boundary
+   */
+  static int padded_ld (int cols);
+
+  /**
+   *
+   * @return true if the matrix frees its elements, false for a view
+   */
+  bool owns_data () const;
+
+  /**
+   *
+   * @return pointer to the first element, elements are stored row by row,
+   * get_ld () floats apart
+   */
+  float *data ();
+
+  /**
+   *
+   * @return pointer to the first element, elements are stored row by row,
+   * get_ld () floats apart
+   */
+  const float *data () const;
+
+  /**
+   * the transpose is stored without padding, in a single copy of a
+   * transposed view (see MatrixView::transpose to transpose without
+   * copying)
    * @return transpose matrix
    */
   Matrix &transpose ();
 
   /**
-   * change the matrix to: rows = rows * cols, and cols = 1
+   * change the matrix to: rows = rows * cols, and cols = 1. Padded rows
+   * are moved together first
    * @return the matrix as vector
    */
   Matrix &vectorize ();
@@ -82,11 +206,39 @@ class Matrix {
   void plain_print ();
 
   /**
-   *
+   * element-wise multiplication, computed lazily (see MatrixExpr.h)
+   * @param m matrix to multi with;
+   * @return dot expression;
+   */
+  MatrixExpr<expr_product<expr_leaf, expr_leaf>> dot (const Matrix &m)
+  const &;
+
+  /**
+   * element-wise multiplication by an expression, computed lazily
+   * @param m expression to multi with;
+   * @return dot expression;
+   */
+  template<class E>
+  MatrixExpr<expr_product<expr_leaf, E>> dot (const MatrixExpr<E> &m)
+  const {
+    return MatrixExpr<expr_leaf> (to_expr (*this)).dot (m);
+  }
+
+  /**
+   * element-wise multiplication by a view, computed lazily
+   * @param m view to multi with;
+   * @return dot expression;
+   */
+  MatrixExpr<expr_product<expr_leaf, expr_leaf>> dot (const MatrixView &m)
+  const;
+
+  /**
+   * dot of a temporary matrix, the result reuses its elements (a view is
+   * copied, its elements are not written)
    * @param m matrix to multi with;
    * @return dot matrix;
    */
-  Matrix dot (const Matrix &m);
+  Matrix dot (const Matrix &m) &&;
 
   /**
    *
@@ -105,42 +257,112 @@ class Matrix {
 
   //Operators
   /**
-   * add the given matrix the the obj
+   * add the given matrix the the obj, computed lazily (see MatrixExpr.h)
+   * @param m matrix to add
+   * @return the sum expression
+   */
+  MatrixExpr<expr_sum<expr_leaf, expr_leaf>> operator+ (const Matrix &m)
+  const &;
+
+  /**
+   * add the given expression to the obj, computed lazily
+   * @param m expression to add
+   * @return the sum expression
+   */
+  template<class E>
+  MatrixExpr<expr_sum<expr_leaf, E>> operator+ (const MatrixExpr<E> &m)
+  const {
+    return MatrixExpr<expr_leaf> (to_expr (*this)) + m;
+  }
+
+  /**
+   * add the given view to the obj, computed lazily
+   * @param m view to add
+   * @return the sum expression
+   */
+  MatrixExpr<expr_sum<expr_leaf, expr_leaf>> operator+ (const MatrixView &m)
+  const;
+
+  /**
+   * add the given matrix to a temporary matrix, the result reuses its
+   * elements (a view is copied, its elements are not written)
    * @param m matrix to add
    * @return the new matrix
    */
-  Matrix operator+ (const Matrix &m);
+  Matrix operator+ (const Matrix &m) &&;
 
   /**
-   * copy the given matrix the the obj
+   * copy the given matrix the the obj, with the leading dimension of m
    * @param m matrix to copy
    * @return the new matrix
    */
   Matrix &operator= (const Matrix &m);
 
   /**
-   * Multiplies the 2 matrix according to the rules of the matrix multi
+   * move the given matrix to the obj, without copying its elements
+   * @param m matrix to move
+   * @return the obj
+   */
+  Matrix &operator= (Matrix &&m) noexcept;
+
+  /**
+   * computes an element-wise expression into the obj in a single pass,
+   * reusing its elements when the dims are the same. A view with the
+   * same dims is written through, into the elements it refers to; with
+   * other dims any matrix (a view too) is replaced by a new one
+   * @param e expression to compute
+   * @return the obj
+   */
+  template<class E>
+  Matrix &operator= (const MatrixExpr<E> &e);
+
+  /**
+   * Multiplies the 2 matrix according to the rules of the matrix multi,
+   * using the matrix-vector kernels when m has at most GEMV_MAX_VECTORS
+   * columns and the blocked gemm kernel otherwise (see Gemm.h). Views
+   * (e.g. transposes) multiply the same way, see MatrixView.h
    * @param m matrix to multi
    * @return the new matrix
    */
   Matrix operator* (const Matrix &m) const;
 
   /**
-   * Multiples between the matrix and scalar with the scalar on the left
+   * Multiples between the matrix and scalar with the scalar on the left,
+   * computed lazily (see MatrixExpr.h)
    * @param s scalar
-   * @return the new matrix
+   * @return the scaled expression
    */
-  Matrix operator* (float s);
+  MatrixExpr<expr_scaled<expr_leaf>> operator* (float s) const &;
 
   /**
-   * Multiples between the matrix and scalar with the scalar on the right
+   * Multiples between a temporary matrix and scalar, the result reuses its
+   * elements (a view is copied, its elements are not written)
    * @param s scalar
    * @return the new matrix
    */
-  friend Matrix operator* (float const s, Matrix &m) {
+  Matrix operator* (float s) &&;
+
+  /**
+   * Multiples between the matrix and scalar with the scalar on the right,
+   * computed lazily
+   * @param s scalar
+   * @return the scaled expression
+   */
+  friend MatrixExpr<expr_scaled<expr_leaf>> operator* (float const s,
+                                                       const Matrix &m) {
     return m * s;
   }
 
+  /**
+   * Multiples between a temporary matrix and scalar with the scalar on the
+   * right, the result reuses its elements
+   * @param s scalar
+   * @return the new matrix
+   */
+  friend Matrix operator* (float const s, Matrix &&m) {
+    return std::move (m) * s;
+  }
+
   /**
    * Adds to the correct matrix, the matrix is accepted as a parameter
    * @param m -  matrix to add
@@ -148,6 +370,14 @@ class Matrix {
    */
   Matrix &operator+= (const Matrix &m);
 
+  /**
+   * Adds an element-wise expression to the matrix in a single pass
+   * @param e -  expression to add
+   * @return
+   */
+  template<class E>
+  Matrix &operator+= (const MatrixExpr<E> &e);
+
   /**
    *
    * @param i row index
@@ -166,14 +396,16 @@ class Matrix {
 
   /**
    *
-   * @param index - index to return
+   * @param index - index to return, in row by row order (the padding is
+   * skipped)
    * @return - the index element in the matrix
    */
   float operator[] (int index) const;
 
   /**
    *
-   * @param index - index to return
+   * @param index - index to return, in row by row order (the padding is
+   * skipped)
    * @return - reference to the index element in the matrix
    */
   float &operator[] (int index);
@@ -186,4 +418,86 @@ class Matrix {
   friend std::ostream &operator<< (std::ostream &os, const Matrix &m);
 };
 
+/**
+ * the node of a matrix operand
+ * @param m the matrix
+ * @return leaf node over its elements
+ */
+inline expr_leaf to_expr (const Matrix &m) {
+  return expr_leaf (m.data (), m.get_rows (), m.get_cols (), m.get_ld ());
+}
+
+template<class E>
+Matrix::Matrix (const MatrixExpr<E> &e)
+    : _matrix_dims{e.get_rows (), e.get_cols ()} {
+  allocate (e.get_rows (), e.get_cols (), e.get_cols ());
+  expr_evaluate (e.node (), _matrix, _ld);
+}
+
+template<class E>
+Matrix &Matrix::operator= (const MatrixExpr<E> &e) {
+  if (_matrix_dims.rows != e.get_rows ()
+      || _matrix_dims.cols != e.get_cols ()) {
+    // computed before the old elements (maybe an operand) are released
+    return *this = Matrix (e);
+  }
+  evaluate (e.node ());
+  return *this;
+}
+
+template<class E>
+Matrix &Matrix::operator+= (const MatrixExpr<E> &e) {
+  evaluate (expr_sum<expr_leaf, E> (to_expr (*this), e.node ()));
+  return *this;
+}
+
+template<class E>
+void Matrix::evaluate (const E &node) {
+  const float *end = _matrix + (size_t) (_matrix_dims.rows - 1) * _ld
+                     + _matrix_dims.cols;
+  if (!node.aliases (_matrix, _ld, end)) {
+    expr_evaluate (node, _matrix, _ld);
+    return;
+  }
+  Matrix result ((MatrixExpr<E> (node)));
+  if (owns_data () && is_contiguous ()) {
+    *this = std::move (result);
+    return;
+  }
+  for (int r = 0; r < _matrix_dims.rows; ++r) {
+    std::memcpy (_matrix + (size_t) r * _ld,
+                 result._matrix + (size_t) r * result._ld,
+                 _matrix_dims.cols * sizeof (float));
+  }
+}
+
+template<class E>
+Matrix MatrixExpr<E>::operator* (const Matrix &m) const {
+  return Matrix (*this) * m;
+}
+
+template<class E>
+Matrix MatrixExpr<E>::transpose () const {
+  Matrix result (*this);
+  result.transpose ();
+  return result;
+}
+
+template<class E>
+Matrix MatrixExpr<E>::vectorize () const {
+  Matrix result (*this);
+  result.vectorize ();
+  return result;
+}
+
+/**
+ * print the result of an expression (see operator<< of Matrix)
+ * @param os - out stream
+ * @return os
+ */
+template<class E>
+std::ostream &operator<< (std::ostream &os, const MatrixExpr<E> &e) {
+  return os << Matrix (e);
+}
+
 #endif //MATRIX_H
@@ -0,0 +1,434 @@
+// MatrixExpr.h
+#ifndef MATRIXEXPR_H
+#define MATRIXEXPR_H
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Expression templates of the element-wise Matrix arithmetic (+, dot and
+ * scaling). An operator does not compute anything, it returns a small
+ * MatrixExpr that refers to its operands, and the whole tree is computed
+ * in a single loop when it is assigned to (or constructs) a Matrix. So
+ * s * (a + b).dot (c) reads every operand once and allocates only the
+ * result. The operands are referred to, not copied: an expression must be
+ * used in the statement that builds it (do not keep one in an auto).
+ * The members a Matrix offers to read its elements (get_rows, operator (),
+ * operator [], norm, plain_print, transpose, vectorize) are offered by the
+ * expressions too, so (a + b).plain_print () computes nothing more than
+ * it did when operators returned matrices.
+ *
+ * Operands are matrices, views (MatrixView.h, transposed ones too) or
+ * other expressions. Nodes are read by (row, col). When every operand
+ * (and the result) is stored without row padding the loop runs over the
+ * elements as a single row, otherwise it runs row by row, skipping the
+ * padding.
+ *
+ * The result may be one of the operands, as long as that operand is read
+ * as stored: element (r, c) of the result then only reads element (r, c)
+ * of it, which is not written before. Any other operand over elements of
+ * the result (read transposed, or a block at another offset or row
+ * stride) may read an element the loop has already overwritten, so such
+ * an expression is computed into a new matrix first (see aliases and
+ * Matrix::operator=).
+ */
+
+class Matrix;
+class MatrixView;
+
+#if defined(__GNUC__)
+// number of floats computed together by the evaluation loop
+#define EXPR_LANES 4
+typedef float expr_packet __attribute__ ((vector_size (EXPR_LANES
+                                                       * sizeof (float))));
+#endif
+
+/**
+ * exits (code == 1) if two operands do not have the same dims
+ */
+inline void expr_check_dims (int rows, int cols, int other_rows,
+                             int other_cols) {
+  if (rows != other_rows || cols != other_cols) {
+    std::cerr << "Error: cols and rows of the new matrix must be equal to"
+                 " the old one" << std::endl;
+    exit (EXIT_FAILURE);
+  }
+}
+
+/**
+ * leaf of an expression, the elements of a matrix or of a view: rows are
+ * ld floats apart, or columns when transposed
+ */
+class expr_leaf {
+
+ private:
+  const float *_data;
+  int _rows, _cols, _ld;
+  bool _transposed;
+
+ public:
+  expr_leaf (const float *data, int rows, int cols, int ld,
+             bool transposed = false)
+      : _data (data), _rows (rows), _cols (cols), _ld (ld),
+        _transposed (transposed) {}
+
+  int get_rows () const { return _rows; }
+
+  int get_cols () const { return _cols; }
+
+  bool contiguous () const {
+    return !_transposed && (_ld == _cols || _rows == 1);
+  }
+
+  bool aliases (const float *dest, int ld, const float *end) const {
+    // a transposed leaf spans _cols stored rows of _rows elements
+    const float *last = _transposed
+                        ? _data + (size_t) (_cols - 1) * _ld + _rows
+                        : _data + (size_t) (_rows - 1) * _ld + _cols;
+    if (_data >= end || dest >= last) {
+      return false;
+    }
+    // the destination itself, read as stored
+    return _transposed || _data != dest || _ld != ld;
+  }
+
+  float at (int r, int c) const {
+    return _transposed ? _data[(size_t) c * _ld + r]
+                       : _data[(size_t) r * _ld + c];
+  }
+
+#if defined(EXPR_LANES)
+  expr_packet packet (int r, int c) const {
+    expr_packet p;
+    if (_transposed) {
+      for (int l = 0; l < EXPR_LANES; ++l) {
+        p[l] = at (r, c + l);
+      }
+      return p;
+    }
+    std::memcpy (&p, _data + (size_t) r * _ld + c, sizeof (p));
+    return p;
+  }
+#endif
+};
+
+/**
+ * element-wise sum of two expressions
+ */
+template<class L, class R>
+class expr_sum {
+
+ private:
+  L _l;
+  R _r;
+
+ public:
+  expr_sum (const L &l, const R &r) : _l (l), _r (r) {
+    expr_check_dims (l.get_rows (), l.get_cols (), r.get_rows (),
+                     r.get_cols ());
+  }
+
+  int get_rows () const { return _l.get_rows (); }
+
+  int get_cols () const { return _l.get_cols (); }
+
+  bool contiguous () const { return _l.contiguous () && _r.contiguous (); }
+
+  bool aliases (const float *dest, int ld, const float *end) const {
+    return _l.aliases (dest, ld, end) || _r.aliases (dest, ld, end);
+  }
+
+  float at (int r, int c) const { return _l.at (r, c) + _r.at (r, c); }
+
+#if defined(EXPR_LANES)
+  expr_packet packet (int r, int c) const {
+    return _l.packet (r, c) + _r.packet (r, c);
+  }
+#endif
+};
+
+/**
+ * element-wise product (Matrix::dot) of two expressions
+ */
+template<class L, class R>
+class expr_product {
+
+ private:
+  L _l;
+  R _r;
+
+ public:
+  expr_product (const L &l, const R &r) : _l (l), _r (r) {
+    expr_check_dims (l.get_rows (), l.get_cols (), r.get_rows (),
+                     r.get_cols ());
+  }
+
+  int get_rows () const { return _l.get_rows (); }
+
+  int get_cols () const { return _l.get_cols (); }
+
+  bool contiguous () const { return _l.contiguous () && _r.contiguous (); }
+
+  bool aliases (const float *dest, int ld, const float *end) const {
+    return _l.aliases (dest, ld, end) || _r.aliases (dest, ld, end);
+  }
+
+  float at (int r, int c) const { return _l.at (r, c) * _r.at (r, c); }
+
+#if defined(EXPR_LANES)
+  expr_packet packet (int r, int c) const {
+    return _l.packet (r, c) * _r.packet (r, c);
+  }
+#endif
+};
+
+/**
+ * an expression multiplied by a scalar
+ */
+template<class E>
+class expr_scaled {
+
+ private:
+  E _e;
+  float _s;
+
+ public:
+  expr_scaled (const E &e, float s) : _e (e), _s (s) {}
+
+  int get_rows () const { return _e.get_rows (); }
+
+  int get_cols () const { return _e.get_cols (); }
+
+  bool contiguous () const { return _e.contiguous (); }
+
+  bool aliases (const float *dest, int ld, const float *end) const {
+    return _e.aliases (dest, ld, end);
+  }
+
+  float at (int r, int c) const { return _e.at (r, c) * _s; }
+
+#if defined(EXPR_LANES)
+  expr_packet packet (int r, int c) const { return _e.packet (r, c) * _s; }
+#endif
+};
+
+template<class E>
+class MatrixExpr;
+
+/**
+ * the node of a matrix operand (defined in Matrix.h)
+ */
+expr_leaf to_expr (const Matrix &m);
+
+/**
+ * the node of a view operand (defined in MatrixView.h)
+ */
+expr_leaf to_expr (const MatrixView &v);
+
+/**
+ * the node of an expression operand
+ */
+template<class E>
+const E &to_expr (const MatrixExpr<E> &m) {
+  return m.node ();
+}
+
+/**
+ * node type of an operand (a Matrix or a MatrixExpr), no type for others
+ */
+template<class T>
+using expr_node_t = typename std::decay<decltype (to_expr (
+    std::declval<const T &> ()))>::type;
+
+/**
+ * Computes the first count elements of row r of an expression
+ * @param e the expression
+ * @param r the row
+ * @param count number of elements
+ * @param out receives the elements of the row
+ */
+template<class E>
+void expr_evaluate_row (const E &e, int r, int count, float *out) {
+  int i = 0;
+#if defined(EXPR_LANES)
+  for (; i + 2 * EXPR_LANES <= count; i += 2 * EXPR_LANES) {
+    expr_packet p0 = e.packet (r, i);
+    expr_packet p1 = e.packet (r, i + EXPR_LANES);
+    std::memcpy (out + i, &p0, sizeof (p0));
+    std::memcpy (out + i + EXPR_LANES, &p1, sizeof (p1));
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i] = e.at (r, i);
+  }
+}
+
+/**
+ * Computes every element of an expression into out (rows of cols floats,
+ * ld floats apart). out may be an operand read as stored, not one that
+ * aliases it otherwise (see the top of the file)
+ * @param e the expression
+ * @param out receives the elements
+ * @param ld floats from a row of out to the next
+ */
+template<class E>
+void expr_evaluate (const E &e, float *out, int ld) {
+  int rows = e.get_rows (), cols = e.get_cols ();
+  if ((ld == cols || rows == 1) && e.contiguous ()) {
+    // row 0 of a contiguous leaf goes on over the following rows
+    expr_evaluate_row (e, 0, rows * cols, out);
+    return;
+  }
+  for (int r = 0; r < rows; ++r) {
+    expr_evaluate_row (e, r, cols, out + (size_t) r * ld);
+  }
+}
+
+/**
+ * A lazy element-wise Matrix expression, see the top of the file
+ */
+template<class E>
+class MatrixExpr {
+
+ private:
+  E _e;
+
+ public:
+  explicit MatrixExpr (const E &e) : _e (e) {}
+
+  /**
+   *
+   * @return the root node of the expression
+   */
+  const E &node () const { return _e; }
+
+  /**
+   *
+   * @return num of rows of the result
+   */
+  int get_rows () const { return _e.get_rows (); }
+
+  /**
+   *
+   * @return num of cols of the result
+   */
+  int get_cols () const { return _e.get_cols (); }
+
+  /**
+   *
+   * @param index - index to compute
+   * @return - the index element of the result
+   */
+  float operator[] (int index) const {
+    return _e.at (index / get_cols (), index % get_cols ());
+  }
+
+  /**
+   * adds a matrix or an expression
+   * @param m operand to add
+   * @return the sum expression
+   */
+  template<class T>
+  MatrixExpr<expr_sum<E, expr_node_t<T>>> operator+ (const T &m) const {
+    return MatrixExpr<expr_sum<E, expr_node_t<T>>> (
+        expr_sum<E, expr_node_t<T>> (_e, to_expr (m)));
+  }
+
+  /**
+   * element-wise multiplication by a matrix or an expression
+   * @param m operand to multi with
+   * @return the product expression
+   */
+  template<class T>
+  MatrixExpr<expr_product<E, expr_node_t<T>>> dot (const T &m) const {
+    return MatrixExpr<expr_product<E, expr_node_t<T>>> (
+        expr_product<E, expr_node_t<T>> (_e, to_expr (m)));
+  }
+
+  /**
+   * Multiples between the expression and scalar
+   * @param s scalar
+   * @return the scaled expression
+   */
+  MatrixExpr<expr_scaled<E>> operator* (float s) const {
+    return MatrixExpr<expr_scaled<E>> (expr_scaled<E> (_e, s));
+  }
+
+  /**
+   * Multiples between the expression and scalar with the scalar on the
+   * right
+   * @param s scalar
+   * @return the scaled expression
+   */
+  friend MatrixExpr<expr_scaled<E>> operator* (float s, const MatrixExpr &m) {
+    return m * s;
+  }
+
+  /**
+   * Multiplies the result by a matrix according to the rules of the
+   * matrix multi (defined in Matrix.h)
+   * @param m matrix to multi
+   * @return the new matrix
+   */
+  Matrix operator* (const Matrix &m) const;
+
+  /**
+   *
+   * @return the norm of the result, computed without storing it
+   */
+  float norm () const {
+    float sum = 0;
+    for (int r = 0; r < get_rows (); ++r) {
+      for (int c = 0; c < get_cols (); ++c) {
+        float value = _e.at (r, c);
+        sum += value * value;
+      }
+    }
+    return sqrtf (sum);
+  }
+
+  /**
+   *
+   * @param i row index
+   * @param j col index
+   * @return the i,j element of the result
+   */
+  float operator() (int i, int j) const {
+    if (i >= get_rows () || j >= get_cols () || i < 0 || j < 0) {
+      std::cerr << "Error: index out of range" << std::endl;
+      exit (EXIT_FAILURE);
+    }
+    return _e.at (i, j);
+  }
+
+  /**
+   * Prints the elements of the result, like Matrix::plain_print
+   */
+  void plain_print () const {
+    for (int r = 0; r < get_rows (); ++r) {
+      for (int c = 0; c < get_cols (); ++c) {
+        std::cout << _e.at (r, c) << " ";
+      }
+      std::cout << std::endl;
+    }
+    std::cout << std::endl;
+  }
+
+  /**
+   * (defined in Matrix.h)
+   * @return the transpose of the result
+   */
+  Matrix transpose () const;
+
+  /**
+   * (defined in Matrix.h)
+   * @return the result as a (rows * cols) x 1 vector
+   */
+  Matrix vectorize () const;
+};
+
+#endif //MATRIXEXPR_H
@@ -0,0 +1,206 @@
+#include "MatrixView.h"
+#include "Gemm.h"
+
+/**
+ * empty view (no elements, a null data ())
+ */
+MatrixView::MatrixView ()
+    : _data (nullptr), _rows (0), _cols (0), _ld (0), _transposed (false) {
+}
+
+/**
+ * view over existing elements
+ * @param data first element
+ * @param rows num of rows of the view
+ * @param cols num of cols of the view
+ * @param ld floats between two stored rows
+ * @param transposed true if element (i, j) is data[j * ld + i]
+ */
+MatrixView::MatrixView (const float *data, int rows, int cols, int ld,
+                        bool transposed)
+    : _data (data), _rows (rows), _cols (cols), _ld (ld),
+      _transposed (transposed) {
+  if (rows <= 0 || cols <= 0 || data == nullptr
+      || ld < (transposed ? rows : cols)) {
+    std::cerr << "Error: the cols and rows must be a positive number"
+              << std::endl;
+    exit (EXIT_FAILURE);
+  }
+}
+
+/**
+ * view of a whole matrix
+ * @param m the matrix
+ */
+MatrixView::MatrixView (const Matrix &m)
+    : MatrixView (m.data (), m.get_rows (), m.get_cols (), m.get_ld ()) {
+}
+
+/**
+ *
+ * @return num of rows of the view
+ */
+int MatrixView::get_rows () const {
+  return _rows;
+}
+
+/**
+ *
+ * @return num of cols of the view
+ */
+int MatrixView::get_cols () const {
+  return _cols;
+}
+
+/**
+ *
+ * @return floats between two stored rows
+ */
+int MatrixView::get_ld () const {
+  return _ld;
+}
+
+/**
+ *
+ * @return true if the view is a transpose of the stored rows
+ */
+bool MatrixView::is_transposed () const {
+  return _transposed;
+}
+
+/**
+ *
+ * @return true if the rows of the view follow each other in storage
+ */
+bool MatrixView::is_contiguous () const {
+  if (_transposed) {
+    return _cols == 1 || (_rows == 1 && _ld == 1);
+  }
+  return _ld == _cols || _rows == 1;
+}
+
+/**
+ *
+ * @return floats from element (i, j) to element (i + 1, j)
+ */
+int MatrixView::row_stride () const {
+  return _transposed ? 1 : _ld;
+}
+
+/**
+ *
+ * @return floats from element (i, j) to element (i, j + 1)
+ */
+int MatrixView::col_stride () const {
+  return _transposed ? _ld : 1;
+}
+
+/**
+ *
+ * @return pointer to element (0, 0)
+ */
+const float *MatrixView::data () const {
+  return _data;
+}
+
+/**
+ *
+ * @param i row index
+ * @param j col index
+ * @return the i,j element of the view
+ */
+float MatrixView::operator() (int i, int j) const {
+  if (i >= _rows || j >= _cols || i < 0 || j < 0) {
+    std::cerr << "Error: index out of range" << std::endl;
+    exit (EXIT_FAILURE);
+  }
+  return _data[(size_t) i * row_stride () + (size_t) j * col_stride ()];
+}
+
+/**
+ * exits (code == 1) if the block is not inside the view
+ * @param row first row of the block
+ * @param col first col of the block
+ * @param rows num of rows of the block
+ * @param cols num of cols of the block
+ * @return view of the block
+ */
+MatrixView MatrixView::block (int row, int col, int rows, int cols) const {
+  if (row < 0 || col < 0 || rows <= 0 || cols <= 0 || row > _rows - rows
+      || col > _cols - cols) {
+    std::cerr << "Error: index out of range" << std::endl;
+    exit (EXIT_FAILURE);
+  }
+  return MatrixView (_data + (size_t) row * row_stride ()
+                     + (size_t) col * col_stride (), rows, cols, _ld,
+                     _transposed);
+}
+
+/**
+ *
+ * @param i row index
+ * @return view of row i (1 x cols)
+ */
+MatrixView MatrixView::row (int i) const {
+  return block (i, 0, 1, _cols);
+}
+
+/**
+ *
+ * @param j col index
+ * @return view of col j (rows x 1)
+ */
+MatrixView MatrixView::col (int j) const {
+  return block (0, j, _rows, 1);
+}
+
+/**
+ *
+ * @return view of the transpose, nothing is moved
+ */
+MatrixView MatrixView::transpose () const {
+  return MatrixView (_data, _cols, _rows, _ld, !_transposed);
+}
+
+/**
+ * the view as a (rows * cols) x 1 vector. Exits (code == 1) if the view
+ * is not contiguous
+ * @return view of the vector
+ */
+MatrixView MatrixView::vectorize () const {
+  if (!is_contiguous ()) {
+    std::cerr << "Error: only a contiguous view can be vectorized"
+              << std::endl;
+    exit (EXIT_FAILURE);
+  }
+  return MatrixView (_data, _rows * _cols, 1, 1);
+}
+
+/**
+ * Multiples between the view and scalar, computed lazily
+ * @param s scalar
+ * @return the scaled expression
+ */
+MatrixExpr<expr_scaled<expr_leaf>> MatrixView::operator* (float s) const {
+  return MatrixExpr<expr_leaf> (to_expr (*this)) * s;
+}
+
+/**
+ * Multiplies two views according to the rules of the matrix multi, the
+ * strides of both go to gemm_strided
+ * @param a left operand
+ * @param b right operand
+ * @return the new matrix
+ */
+Matrix operator* (const MatrixView &a, const MatrixView &b) {
+  if (a.get_cols () != b.get_rows ()) {
+    std::cerr << "Error: rows of the new matrix must be equal to"
+                 " the cols of the old one" << std::endl;
+    exit (EXIT_FAILURE);
+  }
+  Matrix product (a.get_rows (), b.get_cols ());
+  gemm_strided (a.get_rows (), b.get_cols (), a.get_cols (), a.data (),
+                a.row_stride (), a.col_stride (), b.data (), b.row_stride (),
+                b.col_stride (), product.data (), product.get_ld ());
+  return product;
+}
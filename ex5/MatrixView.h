@@ -0,0 +1,205 @@
+// MatrixView.h
+#ifndef MATRIXVIEW_H
+#define MATRIXVIEW_H
+
+#include "Matrix.h"
+
+/**
+ * A read only view of matrix elements that shares their storage: a
+ * pointer, the dims, the distance between stored rows and a transposed
+ * flag. Blocks, rows, columns and transposes of a view are views of the
+ * same elements, so none of them copies or allocates anything. The
+ * products and the element-wise expressions take views as operands, and
+ * Matrix (view) copies the elements when they have to be owned.
+ * A view must not outlive the elements it refers to.
+ */
+class MatrixView {
+
+ private:
+  const float *_data;
+  int _rows, _cols;
+  // floats between two stored rows (stored columns of a transposed view)
+  int _ld;
+  bool _transposed;
+
+ public:
+
+  /**
+   * empty view (no elements, a null data ())
+   */
+  MatrixView ();
+
+  /**
+   * view over existing elements
+   * @param data first element
+   * @param rows num of rows of the view
+   * @param cols num of cols of the view
+   * @param ld floats between two stored rows
+   * @param transposed true if element (i, j) is data[j * ld + i] instead of
+   * data[i * ld + j]
+   */
+  MatrixView (const float *data, int rows, int cols, int ld,
+              bool transposed = false);
+
+  /**
+   * view of a whole matrix
+   * @param m the matrix
+   */
+  MatrixView (const Matrix &m);
+
+  /**
+   *
+   * @return num of rows of the view
+   */
+  int get_rows () const;
+
+  /**
+   *
+   * @return num of cols of the view
+   */
+  int get_cols () const;
+
+  /**
+   *
+   * @return floats between two stored rows
+   */
+  int get_ld () const;
+
+  /**
+   *
+   * @return true if the view is a transpose of the stored rows
+   */
+  bool is_transposed () const;
+
+  /**
+   *
+   * @return true if the rows of the view follow each other in storage,
+   * so the rows * cols elements are contiguous in data ()
+   */
+  bool is_contiguous () const;
+
+  /**
+   *
+   * @return floats from element (i, j) to element (i + 1, j)
+   */
+  int row_stride () const;
+
+  /**
+   *
+   * @return floats from element (i, j) to element (i, j + 1)
+   */
+  int col_stride () const;
+
+  /**
+   *
+   * @return pointer to element (0, 0)
+   */
+  const float *data () const;
+
+  /**
+   *
+   * @param i row index
+   * @param j col index
+   * @return the i,j element of the view
+   */
+  float operator() (int i, int j) const;
+
+  /**
+   * exits (code == 1) if the block is not inside the view
+   * @param row first row of the block
+   * @param col first col of the block
+   * @param rows num of rows of the block
+   * @param cols num of cols of the block
+   * @return view of the block
+   */
+  MatrixView block (int row, int col, int rows, int cols) const;
+
+  /**
+   *
+   * @param i row index
+   * @return view of row i (1 x cols)
+   */
+  MatrixView row (int i) const;
+
+  /**
+   *
+   * @param j col index
+   * @return view of col j (rows x 1)
+   */
+  MatrixView col (int j) const;
+
+  /**
+   *
+   * @return view of the transpose, nothing is moved
+   */
+  MatrixView transpose () const;
+
+  /**
+   * the view as a (rows * cols) x 1 vector, the viewed matrix keeps its
+   * dims. Exits (code == 1) if the view is not contiguous
+   * @return view of the vector
+   */
+  MatrixView vectorize () const;
+
+  /**
+   * element-wise sum with a matrix, a view or an expression, computed
+   * lazily (see MatrixExpr.h)
+   * @param m operand to add
+   * @return the sum expression
+   */
+  template<class T>
+  MatrixExpr<expr_sum<expr_leaf, expr_node_t<T>>> operator+ (const T &m)
+  const {
+    return MatrixExpr<expr_leaf> (to_expr (*this)) + m;
+  }
+
+  /**
+   * element-wise multiplication by a matrix, a view or an expression,
+   * computed lazily
+   * @param m operand to multi with
+   * @return the product expression
+   */
+  template<class T>
+  MatrixExpr<expr_product<expr_leaf, expr_node_t<T>>> dot (const T &m)
+  const {
+    return MatrixExpr<expr_leaf> (to_expr (*this)).dot (m);
+  }
+
+  /**
+   * Multiples between the view and scalar, computed lazily
+   * @param s scalar
+   * @return the scaled expression
+   */
+  MatrixExpr<expr_scaled<expr_leaf>> operator* (float s) const;
+
+  /**
+   * Multiples between the view and scalar with the scalar on the left
+   * @param s scalar
+   * @return the scaled expression
+   */
+  friend MatrixExpr<expr_scaled<expr_leaf>> operator* (float s,
+                                                       const MatrixView &m) {
+    return m * s;
+  }
+
+  /**
+   * Multiplies two views according to the rules of the matrix multi.
+   * Transposed and strided operands are read in place (see gemm_strided)
+   * @param a left operand
+   * @param b right operand
+   * @return the new matrix
+   */
+  friend Matrix operator* (const MatrixView &a, const MatrixView &b);
+};
+
+/**
+ * the node of a view operand
+ * @param v the view
+ * @return leaf node over its elements
+ */
+inline expr_leaf to_expr (const MatrixView &v) {
+  return expr_leaf (v.data (), v.get_rows (), v.get_cols (), v.get_ld (),
+                    v.is_transposed ());
+}
+
+#endif //MATRIXVIEW_H
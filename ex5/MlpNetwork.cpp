@@ -1,26 +1,317 @@
 #include "MlpNetwork.h"
 
+#include <algorithm>
+
+/**
+ * Finds the most probable digit in a column of the network output
+ * @param output output of the last layer, stored row by row
+ * @param rows number of classes
+ * @param cols number of images in the output
+ * @param col column of the image in the output
+ * @return digit struct of the column
+ */
+static digit max_digit (const float *output, int rows, int cols, int col) {
+  unsigned int index = 0;
+  float max_index = output[col];
+  for (int j = 0; j < rows; j++) {
+    if (max_index < output[j * cols + col]) {
+      index = j;
+      max_index = output[j * cols + col];
+    }
+  }
+  digit digit = {index, max_index};
+  return digit;
+}
+
+/**
+ * constrctor of class for the default topology. The layers refer to the
+ * given weights and biases without copying them.
+ * @param weights
+ * @param biases
+ */
+MlpNetwork::MlpNetwork (const Matrix *weights, const Matrix *biases)
+    : MlpNetwork (weights, biases, layers_activations, MLP_SIZE) {
+}
+
+/**
+ * Builds one layer per parameters set
+ * @tparam M Matrix or MatrixView
+ * @param weights weights[i] is the i'th layer weights matrix
+ * @param biases biases[i] is the i'th layer bias vector
+ * @param activations activations[i] is the i'th layer activation
+ * @param layer_count number of layers
+ * @return the layers
+ */
+template<class M>
+static std::vector<Dense> build_layers (const M *weights, const M *biases,
+                                        const ActivationType *activations,
+                                        int layer_count) {
+  std::vector<Dense> layers;
+  layers.reserve (std::max (layer_count, 0));
+  for (int i = 0; i < layer_count; ++i) {
+    layers.emplace_back (weights[i], biases[i], activations[i]);
+  }
+  return layers;
+}
+
+/**
+ * constrctor of class for any topology, builds the layers once.
+ * Exits (code == 1) if the layers do not fit each other.
+ * @param weights weights[i] is the i'th layer weights matrix
+ * @param biases biases[i] is the i'th layer bias vector
+ * @param activations activations[i] is the i'th layer activation
+ * @param layer_count number of layers
+ */
+MlpNetwork::MlpNetwork (const Matrix *weights, const Matrix *biases,
+                        const ActivationType *activations, int layer_count)
+    : MlpNetwork (build_layers (weights, biases, activations, layer_count)) {
+}
+
+/**
+ * constrctor of class for any topology from views of the parameters.
+ * Exits (code == 1) if the layers do not fit each other.
+ * @param weights weights[i] is the i'th layer weights view
+ * @param biases biases[i] is the i'th layer bias view
+ * @param activations activations[i] is the i'th layer activation
+ * @param layer_count number of layers
+ */
+MlpNetwork::MlpNetwork (const MatrixView *weights, const MatrixView *biases,
+                        const ActivationType *activations, int layer_count)
+    : MlpNetwork (build_layers (weights, biases, activations, layer_count)) {
+}
+
+/**
+ * constrctor of class from layers built by the caller.
+ * Exits (code == 1) if the layers do not fit each other.
+ * @param layers the layers, in order
+ */
+MlpNetwork::MlpNetwork (std::vector<Dense> layers)
+    : _layers (std::move (layers)), _widest (0), _capacity (0) {
+  if (_layers.empty ()) {
+    std::cerr << "Error: the network must have at least one layer"
+              << std::endl;
+    exit (EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < _layers.size (); ++i) {
+    const MatrixView &bias = _layers[i].get_bias ();
+    if ((i > 0 && _layers[i].get_cols () != _layers[i - 1].get_rows ())
+        || bias.get_rows () * bias.get_cols () != _layers[i].get_rows ()
+        || !bias.is_contiguous ()) {
+      std::cerr << "Error: layer " << (i + 1)
+                << " does not fit the previous layer" << std::endl;
+      exit (EXIT_FAILURE);
+    }
+    _widest = std::max (_widest, _layers[i].get_rows ());
+  }
+  // images are mostly background, single ones skip the zero pixels
+  _layers.front ().set_sparse_input (true);
+  reserve (1);
+}
+
+/**
+ * Grows the workspace to hold batches of the given size
+ * @param batch number of images
+ */
+void MlpNetwork::reserve (int batch) {
+  if (batch <= _capacity) {
+    return;
+  }
+  _capacity = batch;
+  _workspace[0] = Matrix (_widest, _capacity);
+  _workspace[1] = Matrix (_widest, _capacity);
+  _inputs = Matrix (input_size (), _capacity);
+}
+
+/**
+ * Chooses the weights storage of every layer (see Dense::set_precision)
+ * @param precision storage to use
+ */
+void MlpNetwork::set_precision (WeightPrecision precision) {
+  for (Dense &layer : _layers) {
+    layer.set_precision (precision);
+  }
+}
+
+/**
+ * Runs every layer sparse enough on sparse weights
+ * @param threshold largest absolute weight to drop
+ * @return number of sparse layers
+ */
+int MlpNetwork::set_sparse (float threshold) {
+  int sparse = 0;
+  for (Dense &layer : _layers) {
+    sparse += layer.set_sparse (threshold);
+  }
+  return sparse;
+}
+
 /**
-* Applies the entire network on input returns digit struct
+ *
+ * @return number of values the network takes (size of an image)
+ */
+int MlpNetwork::input_size () const {
+  return _layers.front ().get_cols ();
+}
+
+/**
+ *
+ * @return number of values the last layer outputs (number of classes)
+ */
+int MlpNetwork::output_size () const {
+  return _layers.back ().get_rows ();
+}
+
+/**
+ * Applies the layers on n inputs, alternating between the workspace
+ * buffers, and finds the digit of every input
+ * @param inputs input_size x n values, one image per column
+ * @param n number of images, at most _capacity
+ * @param digits receives the digit of every image
+ * @param layer_allocs if not null, receives the heap activity of every
+ *        layer
+ */
+void MlpNetwork::forward_batch (const float *inputs, int n, digit *digits,
+                                alloc_stats *layer_allocs) {
+  for (size_t i = 0; i < _layers.size (); ++i) {
+    float *output = _workspace[i % 2].data ();
+    if (layer_allocs == nullptr) {
+      _layers[i].forward (inputs, n, output);
+    } else {
+      alloc_stats before = alloc_count ();
+      _layers[i].forward (inputs, n, output);
+      layer_allocs[i] = alloc_diff (alloc_count (), before);
+    }
+    inputs = output;
+  }
+  for (int c = 0; c < n; ++c) {
+    digits[c] = max_digit (inputs, output_size (), n, c);
+  }
+}
+
+/**
+ *
+ * @return number of layers
+ */
+int MlpNetwork::layer_count () const {
+  return (int) _layers.size ();
+}
+
+/**
+ * The elements of an image as one contiguous vector: its own elements, or
+ * a copy in the inputs buffer when its rows are padded
+ * @param img the image
+ * @return input_size () values
+ */
+const float *MlpNetwork::image_data (const Matrix &img) {
+  if (img.is_contiguous ()) {
+    return img.data ();
+  }
+  float *inputs = _inputs.data ();
+  for (int i = 0; i < input_size (); ++i) {
+    inputs[i] = img[i];
+  }
+  return inputs;
+}
+
+/**
+* Applies the entire network on input returns digit struct.
+* The layers alternate between the two workspace buffers, so nothing is
+* allocated.
 * @param img
 * @return
 */
 digit MlpNetwork::operator() (const Matrix &img) {
-  ActivationType act[MLP_SIZE] = {RELU, RELU, RELU, SOFTMAX};
-  Matrix new_matrix = img;
-  for (int i = 0; i < MLP_SIZE; ++i) {
-    Dense dense (_weights[i], _biases[i], act[i]);
-    new_matrix = dense (new_matrix);
+  if (img.get_rows () * img.get_cols () != input_size ()) {
+    std::cerr << "Error: invalid image size" << std::endl;
+    exit (EXIT_FAILURE);
   }
-  unsigned int index = 0;
-  float max_index = new_matrix[(int) index];
-  for (int j = 0; j < OUTPUT_VEC_SIZE; j++) {
-    if (max_index < new_matrix[j]) {
-      index = j;
-      max_index = new_matrix[j];
+  digit result;
+  forward_batch (image_data (img), 1, &result);
+  return result;
+}
+
+/**
+ * Applies the entire network on input like operator () and counts the
+ * heap activity of every layer
+ * @param img
+ * @param layer_allocs receives the activity of every layer
+ * @return
+ */
+digit MlpNetwork::profile_allocations (const Matrix &img,
+                                       alloc_stats *layer_allocs) {
+  if (img.get_rows () * img.get_cols () != input_size ()) {
+    std::cerr << "Error: invalid image size" << std::endl;
+    exit (EXIT_FAILURE);
+  }
+  digit result;
+  forward_batch (image_data (img), 1, &result, layer_allocs);
+  return result;
+}
+
+/**
+ * Applies the entire network on a batch of images, every layer runs as a
+ * single matrix-matrix product so the weights are reused by all images
+ * @param imgs matrix or view with one flattened image per row
+ * @return digit struct of every image, in the order of the rows
+ */
+std::vector<digit> MlpNetwork::classify_batch (const MatrixView &imgs) {
+  std::vector<digit> digits (imgs.get_rows ());
+  classify_batch (imgs, digits.data ());
+  return digits;
+}
+
+/**
+ * Applies the entire network on a batch of images without allocating
+ * once the workspace holds the batch
+ * @param imgs matrix or view with one flattened image per row, read
+ * through its strides
+ * @param digits receives the digit struct of every row
+ */
+void MlpNetwork::classify_batch (const MatrixView &imgs, digit *digits) {
+  int img_size = input_size ();
+  if (imgs.get_cols () != img_size) {
+    std::cerr << "Error: every row of the batch must be a flattened image"
+              << std::endl;
+    exit (EXIT_FAILURE);
+  }
+  int n = imgs.get_rows ();
+  reserve (n);
+  // layers work on column vectors, so every image becomes a column
+  const float *rows = imgs.data ();
+  size_t row_stride = imgs.row_stride (), col_stride = imgs.col_stride ();
+  float *inputs = _inputs.data ();
+  for (int r = 0; r < n; ++r) {
+    for (int i = 0; i < img_size; ++i) {
+      inputs[(size_t) i * n + r] = rows[r * row_stride + i * col_stride];
     }
   }
-  digit digit = {index, max_index};
-  return digit;
+  forward_batch (inputs, n, digits);
 }
 
+/**
+ * Applies the entire network on a batch of images
+ * @param imgs array of images (each one 28x28 or already vectorized)
+ * @param count number of images in the array
+ * @return digit struct of every image, in the order of the array
+ */
+std::vector<digit> MlpNetwork::classify_batch (const Matrix *imgs,
+                                               int count) {
+  if (count <= 0) {
+    return std::vector<digit> ();
+  }
+  int img_size = input_size ();
+  reserve (count);
+  float *inputs = _inputs.data ();
+  for (int n = 0; n < count; ++n) {
+    if (imgs[n].get_rows () * imgs[n].get_cols () != img_size) {
+      std::cerr << "Error: invalid image size in batch" << std::endl;
+      exit (EXIT_FAILURE);
+    }
+    for (int i = 0; i < img_size; ++i) {
+      inputs[(size_t) i * count + n] = imgs[n][i];
+    }
+  }
+  std::vector<digit> digits (count);
+  forward_batch (inputs, count, digits.data ());
+  return digits;
+}
@@ -5,12 +5,16 @@
 
 #include "Dense.h"
 #include "Matrix.h"
+#include "MatrixView.h"
 #include "Digit.h"
+#include "AllocCounter.h"
+
+#include <vector>
 
 #define MLP_SIZE 4
 #define OUTPUT_VEC_SIZE 10
 
-//
+// default topology, a network can be built with any other one
 const matrix_dims img_dims = {28, 28};
 const matrix_dims weights_dims[] = {{128, 784},
                                     {64,  128},
@@ -20,22 +24,124 @@ const matrix_dims bias_dims[] = {{128, 1},
                                  {64,  1},
                                  {20,  1},
                                  {10,  1}};
+const ActivationType layers_activations[] = {RELU, RELU, RELU, SOFTMAX};
 
 // Insert MlpNetwork class here...
 class MlpNetwork {
 
  private:
-  const Matrix *_weights, *_biases;
+  std::vector<Dense> _layers;
+  // ping-pong activations, widest layer x _capacity images each
+  Matrix _workspace[2];
+  // inputs of a batch, one image per column (input_size x _capacity)
+  Matrix _inputs;
+  int _widest;
+  int _capacity;
+
+  /**
+   * Applies the layers on n inputs, alternating between the workspace
+   * buffers, and finds the digit of every input
+   * @param inputs input_size x n values, one image per column
+   * @param n number of images, at most _capacity
+   * @param digits receives the digit of every image
+   * @param layer_allocs if not null, receives the heap activity of every
+   *        layer
+   */
+  void forward_batch (const float *inputs, int n, digit *digits,
+                      alloc_stats *layer_allocs = nullptr);
+
+  /**
+   * The elements of an image as one contiguous vector: its own elements,
+   * or a copy in _inputs when its rows are padded
+   * @param img the image
+   * @return input_size () values
+   */
+  const float *image_data (const Matrix &img);
 
  public:
 
   /**
- * constrctor of class
+ * constrctor of class for the default topology (MLP_SIZE layers of
+ * weights_dims with layers_activations). The layers refer to the given
+ * weights and biases without copying them, so they must outlive the
+ * network.
  * @param weights
  * @param biases
  */
-  MlpNetwork (const Matrix *weights, const Matrix *biases)
-      : _weights (weights), _biases (biases) {};
+  MlpNetwork (const Matrix *weights, const Matrix *biases);
+
+  /**
+ * constrctor of class for any topology, builds the layers once.
+ * Layer i maps weights[i].get_cols () values to weights[i].get_rows ()
+ * values, so every layer must take the output of the previous one.
+ * Exits (code == 1) if the layers do not fit each other.
+ * @param weights weights[i] is the i'th layer weights matrix
+ * @param biases biases[i] is the i'th layer bias vector
+ * @param activations activations[i] is the i'th layer activation
+ * @param layer_count number of layers
+ */
+  MlpNetwork (const Matrix *weights, const Matrix *biases,
+              const ActivationType *activations, int layer_count);
+
+  /**
+ * constrctor of class for any topology from views of the parameters
+ * (e.g. of mapped files), same as the constructor from matrices.
+ * @param weights weights[i] is the i'th layer weights view
+ * @param biases biases[i] is the i'th layer bias view
+ * @param activations activations[i] is the i'th layer activation
+ * @param layer_count number of layers
+ */
+  MlpNetwork (const MatrixView *weights, const MatrixView *biases,
+              const ActivationType *activations, int layer_count);
+
+  /**
+ * constrctor of class from layers built by the caller (e.g. layers with
+ * 16 bit weights). The first layer skips the zero pixels of single images
+ * (see Dense::set_sparse_input).
+ * Exits (code == 1) if the layers do not fit each other.
+ * @param layers the layers, in order
+ */
+  explicit MlpNetwork (std::vector<Dense> layers);
+
+  /**
+   * Chooses the weights storage of every layer (see Dense::set_precision).
+   * A layer that only has 16 bit weights can only keep them
+   * @param precision storage to use
+   */
+  void set_precision (WeightPrecision precision);
+
+  /**
+   * Runs every layer sparse enough on sparse weights (see
+   * Dense::set_sparse), a negative threshold goes back to dense weights
+   * @param threshold largest absolute weight to drop
+   * @return number of sparse layers
+   */
+  int set_sparse (float threshold);
+
+  /**
+   * Grows the workspace to hold batches of the given size. Batches up to
+   * the largest reserved (or already seen) size allocate nothing.
+   * @param batch number of images
+   */
+  void reserve (int batch);
+
+  /**
+   *
+   * @return number of values the network takes (size of an image)
+   */
+  int input_size () const;
+
+  /**
+   *
+   * @return number of values the last layer outputs (number of classes)
+   */
+  int output_size () const;
+
+  /**
+   *
+   * @return number of layers
+   */
+  int layer_count () const;
 
   /**
    * Applies the entire network on input returns digit struct
@@ -44,6 +150,44 @@ class MlpNetwork {
    */
   digit operator() (const Matrix &img);
 
+  /**
+   * Applies the entire network on input like operator () and counts the
+   * heap activity of every layer (only counted in builds with
+   * MLP_COUNT_ALLOCS, see AllocCounter.h)
+   * @param img
+   * @param layer_allocs receives the activity of every layer, layer_count ()
+   *        entries
+   * @return
+   */
+  digit profile_allocations (const Matrix &img, alloc_stats *layer_allocs);
+
+  /**
+   * Applies the entire network on a batch of images, every layer runs as a
+   * single matrix-matrix product so the weights are reused by all images
+   * @param imgs matrix or view with one flattened image per row
+   * (N x input_size), e.g. the transpose of a matrix with one image per
+   * column
+   * @return digit struct of every image, in the order of the rows
+   */
+  std::vector<digit> classify_batch (const MatrixView &imgs);
+
+  /**
+   * Applies the entire network on a batch of images without allocating
+   * once the workspace holds the batch (see reserve)
+   * @param imgs matrix or view with one flattened image per row
+   * (N x input_size)
+   * @param digits receives the digit struct of every row
+   */
+  void classify_batch (const MatrixView &imgs, digit *digits);
+
+  /**
+   * Applies the entire network on a batch of images
+   * @param imgs array of images (each one 28x28 or already vectorized)
+   * @param count number of images in the array
+   * @return digit struct of every image, in the order of the array
+   */
+  std::vector<digit> classify_batch (const Matrix *imgs, int count);
+
 
 };
 #endif // MLPNETWORK_H
@@ -0,0 +1,391 @@
+#include "ModelBundle.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+/**
+ * rounds an offset up to the bundle alignment
+ * @param offset offset in bytes
+ * @return the aligned offset
+ */
+static uint64_t align_offset (uint64_t offset) {
+  return (offset + BUNDLE_ALIGNMENT - 1) / BUNDLE_ALIGNMENT
+         * BUNDLE_ALIGNMENT;
+}
+
+/**
+ * checks that a tensor lies inside the file at an aligned offset
+ * @param offset offset of the tensor
+ * @param size size of the tensor in bytes
+ * @param file_size size of the file
+ * @return true if the tensor is valid
+ */
+static bool valid_tensor (uint64_t offset, uint64_t size,
+                          uint64_t file_size) {
+  return offset % BUNDLE_ALIGNMENT == 0 && offset <= file_size
+         && size <= file_size - offset;
+}
+
+/**
+ * @param dtype element type
+ * @return size of one element in bytes
+ */
+static uint64_t dtype_size (uint32_t dtype) {
+  return dtype == DTYPE_F32 ? sizeof (float) : sizeof (uint16_t);
+}
+
+/**
+ * @param rows rows of the weights
+ * @param nonzeros number of stored weights
+ * @return size in bytes of DTYPE_CSR weights
+ */
+static uint64_t sparse_size (uint64_t rows, uint64_t nonzeros) {
+  return (rows + 1) * sizeof (int32_t)
+         + nonzeros * (sizeof (int32_t) + sizeof (float));
+}
+
+/**
+ * checks that the DTYPE_CSR weights of a layer lie inside the file, with
+ * non decreasing row offsets from 0 and every column inside the layer
+ * @param file the mapped bundle
+ * @param layer the layer
+ * @return true if the weights are valid
+ */
+static bool valid_sparse_weights (const MappedFile &file,
+                                  const bundle_layer &layer) {
+  if (!valid_tensor (layer.weights_offset, sparse_size (layer.rows, 0),
+                     file.size ())) {
+    return false;
+  }
+  const int32_t *offsets = (const int32_t *) (file.data ()
+                                              + layer.weights_offset);
+  if (offsets[0] != 0) {
+    return false;
+  }
+  for (uint32_t r = 0; r < layer.rows; ++r) {
+    if (offsets[r + 1] < offsets[r]
+        || (uint32_t) (offsets[r + 1] - offsets[r]) > layer.cols) {
+      return false;
+    }
+  }
+  uint64_t nonzeros = (uint64_t) offsets[layer.rows];
+  if (!valid_tensor (layer.weights_offset,
+                     sparse_size (layer.rows, nonzeros), file.size ())) {
+    return false;
+  }
+  const int32_t *columns = offsets + layer.rows + 1;
+  for (uint64_t k = 0; k < nonzeros; ++k) {
+    if (columns[k] < 0 || (uint32_t) columns[k] >= layer.cols) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * writes the elements of a matrix row by row, without the padding
+ * @param os stream to write to
+ * @param m the matrix or view
+ */
+static void write_elements (std::ostream &os, const MatrixView &m) {
+  std::vector<float> row (m.get_cols ());
+  for (int r = 0; r < m.get_rows (); ++r) {
+    for (int c = 0; c < m.get_cols (); ++c) {
+      row[c] = m (r, c);
+    }
+    os.write ((const char *) row.data (), row.size () * sizeof (float));
+  }
+}
+
+/**
+ * maps and validates a bundle file, the previous content is dropped
+ * @param path path of the bundle
+ * @return true on success, false if the file is missing or invalid
+ */
+bool ModelBundle::load (const std::string &path) {
+  _weights.clear ();
+  _biases.clear ();
+  _half_weights.clear ();
+  _sparse_weights.clear ();
+  _packed_weights.clear ();
+  _activations.clear ();
+  _file = MappedFile (path);
+  if (!_file.is_open () || _file.size () < sizeof (bundle_header)) {
+    _file = MappedFile ();
+    return false;
+  }
+  bundle_header header;
+  std::memcpy (&header, _file.data (), sizeof (header));
+  // version 1 records end before packed_offset
+  size_t record_size = header.version == 1
+                       ? offsetof (bundle_layer, packed_offset)
+                       : sizeof (bundle_layer);
+  if (std::memcmp (header.magic, BUNDLE_MAGIC, sizeof (header.magic)) != 0
+      || header.version < 1 || header.version > BUNDLE_VERSION
+      || header.layer_count == 0 || header.layer_count > BUNDLE_MAX_LAYERS
+      || _file.size () < sizeof (bundle_header)
+                         + header.layer_count * record_size) {
+    _file = MappedFile ();
+    return false;
+  }
+
+  const char *records = _file.data () + sizeof (bundle_header);
+  std::vector<bundle_layer> layers (header.layer_count);
+  for (uint32_t i = 0; i < header.layer_count; ++i) {
+    std::memcpy (&layers[i], records + i * record_size, record_size);
+  }
+  for (uint32_t i = 0; i < header.layer_count; ++i) {
+    const bundle_layer &layer = layers[i];
+    if (layer.rows == 0 || layer.cols == 0 || layer.rows > INT32_MAX
+        || layer.cols > INT32_MAX || layer.dtype > DTYPE_CSR
+        || layer.activation >= ACTIVATION_TYPE_COUNT
+        || (i > 0 && layer.cols != layers[i - 1].rows)
+        || (layer.dtype == DTYPE_CSR
+            ? !valid_sparse_weights (_file, layer)
+            : !valid_tensor (layer.weights_offset,
+                             (uint64_t) layer.rows * layer.cols
+                             * dtype_size (layer.dtype), _file.size ()))
+        || !valid_tensor (layer.bias_offset, layer.rows * sizeof (float),
+                          _file.size ())
+        || (layer.packed_offset != 0
+            && (layer.dtype != DTYPE_F32
+                || !valid_tensor (layer.packed_offset,
+                                  gemm_packed_size ((int) layer.rows,
+                                                    (int) layer.cols)
+                                  * sizeof (float), _file.size ())))) {
+      _file = MappedFile ();
+      return false;
+    }
+  }
+
+  _weights.reserve (header.layer_count);
+  _biases.reserve (header.layer_count);
+  for (const bundle_layer &layer : layers) {
+    const char *weights = _file.data () + layer.weights_offset;
+    _half_weights.emplace_back ();
+    _sparse_weights.emplace_back ();
+    _packed_weights.emplace_back ();
+    if (layer.dtype == DTYPE_F32) {
+      _weights.emplace_back ((const float *) weights, (int) layer.rows,
+                             (int) layer.cols, (int) layer.cols);
+      if (layer.packed_offset != 0) {
+        _packed_weights.back () = std::make_shared<const PackedMatrix> (
+            (int) layer.rows, (int) layer.cols,
+            (const float *) (_file.data () + layer.packed_offset));
+      }
+    }
+    else if (layer.dtype == DTYPE_CSR) {
+      const int32_t *offsets = (const int32_t *) weights;
+      const int32_t *columns = offsets + layer.rows + 1;
+      _weights.emplace_back ();
+      _sparse_weights.back () = std::make_shared<const SparseMatrix> (
+          (int) layer.rows, (int) layer.cols, offsets, columns,
+          (const float *) (columns + offsets[layer.rows]));
+    }
+    else {
+      _weights.emplace_back ();
+      _half_weights.back () = std::make_shared<const HalfMatrix> (
+          (int) layer.rows, (int) layer.cols,
+          layer.dtype == DTYPE_F16 ? HALF_FP16 : HALF_BF16,
+          (const uint16_t *) weights);
+    }
+    _biases.emplace_back ((const float *) (_file.data ()
+                                           + layer.bias_offset),
+                          (int) layer.rows, 1, 1);
+    _activations.push_back ((ActivationType) layer.activation);
+  }
+  return true;
+}
+
+/**
+ * writes a bundle file
+ * @param path path of the bundle to create
+ * @param weights weights[i] is the i'th layer weights matrix or view
+ * @param biases biases[i] is the i'th layer bias vector or view
+ * @param activations activations[i] is the i'th layer activation
+ * @param layer_count number of layers
+ * @param dtype element type to store the weights in (not DTYPE_CSR)
+ * @param sparse_threshold when not negative, layers sparse enough are
+ * stored as DTYPE_CSR without the weights at most the threshold
+ * @return true on success
+ */
+bool ModelBundle::write (const std::string &path, const MatrixView *weights,
+                         const MatrixView *biases,
+                         const ActivationType *activations,
+                         int layer_count, BundleDtype dtype,
+                         float sparse_threshold) {
+  if (layer_count <= 0 || layer_count > BUNDLE_MAX_LAYERS
+      || dtype == DTYPE_CSR) {
+    return false;
+  }
+  bundle_header header;
+  std::memcpy (header.magic, BUNDLE_MAGIC, sizeof (header.magic));
+  header.version = BUNDLE_VERSION;
+  header.layer_count = layer_count;
+  header.reserved = 0;
+
+  std::vector<bundle_layer> layers (layer_count);
+  std::vector<std::unique_ptr<SparseMatrix>> sparse (layer_count);
+  std::vector<uint64_t> weights_sizes (layer_count);
+  uint64_t offset = sizeof (bundle_header)
+                    + layer_count * sizeof (bundle_layer);
+  for (int i = 0; i < layer_count; ++i) {
+    if (biases[i].get_rows () * biases[i].get_cols ()
+        != weights[i].get_rows ()) {
+      return false;
+    }
+    layers[i].rows = weights[i].get_rows ();
+    layers[i].cols = weights[i].get_cols ();
+    layers[i].activation = activations[i];
+    layers[i].dtype = dtype;
+    weights_sizes[i] = (uint64_t) layers[i].rows * layers[i].cols
+                       * dtype_size (dtype);
+    if (sparse_threshold >= 0) {
+      sparse[i].reset (new SparseMatrix (weights[i], sparse_threshold));
+      if (sparse[i]->density () <= SPARSE_MAX_DENSITY) {
+        layers[i].dtype = DTYPE_CSR;
+        weights_sizes[i] = sparse_size (layers[i].rows,
+                                        sparse[i]->nonzeros ());
+      }
+      else {
+        sparse[i].reset ();
+      }
+    }
+    layers[i].weights_offset = offset = align_offset (offset);
+    offset += weights_sizes[i];
+    layers[i].bias_offset = offset = align_offset (offset);
+    offset += (uint64_t) layers[i].rows * sizeof (float);
+    if (layers[i].dtype == DTYPE_F32) {
+      // the panels the products read, mapped instead of packed at load
+      layers[i].packed_offset = offset = align_offset (offset);
+      offset += gemm_packed_size (layers[i].rows, layers[i].cols)
+                * sizeof (float);
+    }
+  }
+
+  std::ofstream os (path, std::ios::out | std::ios::binary
+                          | std::ios::trunc);
+  if (!os.is_open ()) {
+    return false;
+  }
+  os.write ((const char *) &header, sizeof (header));
+  os.write ((const char *) layers.data (),
+            layer_count * sizeof (bundle_layer));
+  const char padding[BUNDLE_ALIGNMENT] = {0};
+  offset = sizeof (bundle_header) + layer_count * sizeof (bundle_layer);
+  std::vector<uint16_t> half;
+  for (int i = 0; i < layer_count; ++i) {
+    uint64_t count = (uint64_t) layers[i].rows * layers[i].cols;
+    uint64_t weights_size = weights_sizes[i];
+    os.write (padding, layers[i].weights_offset - offset);
+    if (sparse[i]) {
+      uint64_t nonzeros = sparse[i]->nonzeros ();
+      os.write ((const char *) sparse[i]->offsets (),
+                (layers[i].rows + 1) * sizeof (int32_t));
+      os.write ((const char *) sparse[i]->columns (),
+                nonzeros * sizeof (int32_t));
+      os.write ((const char *) sparse[i]->values (),
+                nonzeros * sizeof (float));
+    }
+    else if (dtype == DTYPE_F32) {
+      write_elements (os, weights[i]);
+    }
+    else {
+      half.resize (count);
+      for (uint32_t r = 0; r < layers[i].rows; ++r) {
+        for (uint32_t c = 0; c < layers[i].cols; ++c) {
+          float value = weights[i] ((int) r, (int) c);
+          half[(uint64_t) r * layers[i].cols + c] =
+              dtype == DTYPE_F16 ? float_to_fp16 (value)
+                                 : float_to_bf16 (value);
+        }
+      }
+      os.write ((const char *) half.data (), weights_size);
+    }
+    offset = layers[i].weights_offset + weights_size;
+    os.write (padding, layers[i].bias_offset - offset);
+    write_elements (os, biases[i]);
+    offset = layers[i].bias_offset + layers[i].rows * sizeof (float);
+    if (layers[i].packed_offset != 0) {
+      PackedMatrix packed (weights[i]);
+      uint64_t packed_size = gemm_packed_size (layers[i].rows,
+                                               layers[i].cols)
+                             * sizeof (float);
+      os.write (padding, layers[i].packed_offset - offset);
+      os.write ((const char *) packed.data (), packed_size);
+      offset = layers[i].packed_offset + packed_size;
+    }
+  }
+  return os.good ();
+}
+
+/**
+ *
+ * @return number of layers in the bundle
+ */
+int ModelBundle::layer_count () const {
+  return (int) _weights.size ();
+}
+
+/**
+ *
+ * @return true if every layer has dense float weights
+ */
+bool ModelBundle::has_float_weights () const {
+  for (size_t i = 0; i < _weights.size (); ++i) {
+    if (_half_weights[i] || _sparse_weights[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ *
+ * @return one layer per bundle layer, reading the mapped file
+ */
+std::vector<Dense> ModelBundle::layers () const {
+  std::vector<Dense> layers;
+  layers.reserve (_weights.size ());
+  for (size_t i = 0; i < _weights.size (); ++i) {
+    if (_half_weights[i]) {
+      layers.emplace_back (_half_weights[i], _biases[i], _activations[i]);
+    }
+    else if (_sparse_weights[i]) {
+      layers.emplace_back (_sparse_weights[i], _biases[i], _activations[i]);
+    }
+    else if (_packed_weights[i]) {
+      layers.emplace_back (_weights[i], _packed_weights[i], _biases[i],
+                           _activations[i]);
+    }
+    else {
+      layers.emplace_back (_weights[i], _biases[i], _activations[i]);
+    }
+  }
+  return layers;
+}
+
+/**
+ * only valid if has_float_weights ()
+ * @return the layers weights, views over the mapped file
+ */
+const MatrixView *ModelBundle::weights () const {
+  return _weights.data ();
+}
+
+/**
+ *
+ * @return the layers biases, views over the mapped file
+ */
+const MatrixView *ModelBundle::biases () const {
+  return _biases.data ();
+}
+
+/**
+ *
+ * @return the layers activations
+ */
+const ActivationType *ModelBundle::activations () const {
+  return _activations.data ();
+}
@@ -0,0 +1,157 @@
+// ModelBundle.h
+#ifndef MODELBUNDLE_H
+#define MODELBUNDLE_H
+
+#include "Activation.h"
+#include "Dense.h"
+#include "HalfMatrix.h"
+#include "MappedFile.h"
+#include "MatrixView.h"
+#include "PackedMatrix.h"
+#include "SparseMatrix.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BUNDLE_MAGIC "MLPB"
+#define BUNDLE_VERSION 2
+#define BUNDLE_ALIGNMENT 64
+#define BUNDLE_MAX_LAYERS 1024
+
+/**
+ * @enum BundleDtype
+ * @brief Element type of the tensors of a bundle layer.
+ */
+enum BundleDtype
+{
+    DTYPE_F32 = 0,
+    DTYPE_F16 = 1,
+    DTYPE_BF16 = 2,
+    DTYPE_CSR = 3
+};
+
+/**
+ * @struct bundle_header
+ * @brief First bytes of a bundle file, followed by layer_count
+ *        bundle_layer records.
+ */
+typedef struct bundle_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t layer_count;
+    uint32_t reserved;
+} bundle_header;
+
+/**
+ * @struct bundle_layer
+ * @brief Description of one layer: weights are rows x cols elements of
+ *        dtype, the bias is rows x 1 floats, both stored row by row at
+ *        BUNDLE_ALIGNMENT aligned offsets from the start of the file.
+ *        DTYPE_CSR weights are the rows + 1 int32 row offsets, then the
+ *        int32 column and the float value of every non zero weight
+ *        (nonzeros = the last offset), see SparseMatrix.
+ *        DTYPE_F32 weights are also stored in the panel layout of the
+ *        product kernels (gemm_packed_size (rows, cols) floats, see
+ *        gemm_pack) at packed_offset, 0 when absent. Version 1 records
+ *        end before packed_offset.
+ */
+typedef struct bundle_layer {
+    uint32_t rows, cols;
+    uint32_t activation;
+    uint32_t dtype;
+    uint64_t weights_offset, bias_offset;
+    uint64_t packed_offset;
+} bundle_layer;
+
+/**
+ * A model bundle: one file holding the topology and every parameter of an
+ * mlp network. All numbers are in the byte order of the host.
+ * The file is mapped read-only as a whole and validated in one go, the
+ * weights and biases are const views over the mapped (64 bytes aligned)
+ * payloads. Weights are floats (with their packed panels), 16 bit floats
+ * or sparse float rows, which the layers read without converting or
+ * packing, so processes that load the same bundle share one physical
+ * copy of every tensor.
+ */
+class ModelBundle {
+
+ private:
+  MappedFile _file;
+  // _weights[i] is empty when layer i has 16 bit or sparse weights
+  std::vector<MatrixView> _weights, _biases;
+  std::vector<std::shared_ptr<const HalfMatrix>> _half_weights;
+  std::vector<std::shared_ptr<const SparseMatrix>> _sparse_weights;
+  // null when layer i has no packed panels
+  std::vector<std::shared_ptr<const PackedMatrix>> _packed_weights;
+  std::vector<ActivationType> _activations;
+
+ public:
+
+  /**
+   * maps and validates a bundle file, the previous content is dropped
+   * @param path path of the bundle
+   * @return true on success, false if the file is missing or invalid
+   */
+  bool load (const std::string &path);
+
+  /**
+   * writes a bundle file
+   * @param path path of the bundle to create
+   * @param weights weights[i] is the i'th layer weights matrix or view
+   * @param biases biases[i] is the i'th layer bias vector or view
+   * @param activations activations[i] is the i'th layer activation
+   * @param layer_count number of layers
+   * @param dtype element type to store the weights in (not DTYPE_CSR),
+   * DTYPE_F32 weights are also stored packed for the product kernels
+   * @param sparse_threshold when not negative, the float weights of every
+   * layer sparse enough (see Dense::set_sparse) are stored as DTYPE_CSR,
+   * without the weights whose absolute value is at most the threshold
+   * @return true on success
+   */
+  static bool write (const std::string &path, const MatrixView *weights,
+                     const MatrixView *biases,
+                     const ActivationType *activations, int layer_count,
+                     BundleDtype dtype = DTYPE_F32,
+                     float sparse_threshold = -1);
+
+  /**
+   *
+   * @return number of layers in the bundle
+   */
+  int layer_count () const;
+
+  /**
+   *
+   * @return true if every layer has dense float weights
+   */
+  bool has_float_weights () const;
+
+  /**
+   *
+   * @return one layer per bundle layer, reading the mapped file (float
+   * layers read the stored panels)
+   */
+  std::vector<Dense> layers () const;
+
+  /**
+   * only valid if has_float_weights ()
+   * @return the layers weights, views over the mapped file
+   */
+  const MatrixView *weights () const;
+
+  /**
+   *
+   * @return the layers biases, views over the mapped file
+   */
+  const MatrixView *biases () const;
+
+  /**
+   *
+   * @return the layers activations
+   */
+  const ActivationType *activations () const;
+};
+
+#endif //MODELBUNDLE_H
@@ -0,0 +1,81 @@
+#include "PackedMatrix.h"
+
+/**
+ * packs the given weights
+ * @param w weights matrix or view
+ */
+PackedMatrix::PackedMatrix (const MatrixView &w)
+    : _rows (w.get_rows ()), _cols (w.get_cols ()),
+      _storage (gemm_packed_size (w.get_rows (), w.get_cols ())
+                + GEMM_PACK_ALIGNMENT / sizeof (float)) {
+  uintptr_t address = (uintptr_t) _storage.data ();
+  address = (address + GEMM_PACK_ALIGNMENT - 1)
+            / GEMM_PACK_ALIGNMENT * GEMM_PACK_ALIGNMENT;
+  gemm_pack (_rows, _cols, w.data (), w.row_stride (), w.col_stride (),
+             (float *) address);
+  _data = (const float *) address;
+}
+
+/**
+ * view over existing panels, which must outlive the matrix
+ * @param rows num of rows of the weights
+ * @param cols num of cols of the weights
+ * @param data gemm_packed_size (rows, cols) floats packed by gemm_pack,
+ * GEMM_PACK_ALIGNMENT aligned
+ */
+PackedMatrix::PackedMatrix (int rows, int cols, const float *data)
+    : _rows (rows), _cols (cols), _data (data) {
+}
+
+/**
+ *
+ * @return num of rows of the weights
+ */
+int PackedMatrix::get_rows () const {
+  return _rows;
+}
+
+/**
+ *
+ * @return num of cols of the weights
+ */
+int PackedMatrix::get_cols () const {
+  return _cols;
+}
+
+/**
+ *
+ * @return first element of the panels (see gemm_pack)
+ */
+const float *PackedMatrix::data () const {
+  return _data;
+}
+
+/**
+ * out = W * in for n inputs, with the bias / relu epilogue applied
+ * @param in cols x n inputs, stored row by row (one input per column)
+ * @param n number of inputs
+ * @param out receives the rows x n outputs, stored row by row
+ * @param epilogue bias / relu applied on every output
+ */
+void PackedMatrix::multiply (const float *in, int n, float *out,
+                             gemm_epilogue epilogue) const {
+  gemm_packed (_rows, n, _cols, _data, in, n, out, n, epilogue);
+}
+
+/**
+ * out = W * in for a single input, reading only the weight columns of the
+ * listed input elements
+ * @param in the input vector
+ * @param nonzeros indexes of the non zero elements of in
+ * @param count number of indexes
+ * @param out receives the rows outputs
+ * @param epilogue bias / relu applied on every output
+ */
+void PackedMatrix::multiply_sparse_input (const float *in,
+                                          const int32_t *nonzeros, int count,
+                                          float *out,
+                                          gemm_epilogue epilogue) const {
+  gemv_packed_sparse_input (_rows, _cols, _data, in, nonzeros, count, out,
+                            epilogue);
+}
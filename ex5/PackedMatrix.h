@@ -0,0 +1,90 @@
+// PackedMatrix.h
+#ifndef PACKEDMATRIX_H
+#define PACKEDMATRIX_H
+
+#include "Gemm.h"
+#include "MatrixView.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * A float weight matrix reordered once into the panel layout the product
+ * kernels read (see gemm_pack): panels of GEMM_MR interleaved rows, padded
+ * with zero rows to a whole panel, GEMM_PACK_ALIGNMENT aligned. The
+ * products stream the panels sequentially and never pack the weights
+ * again, whatever the number of inputs. The panels are packed into an
+ * owned copy, or are existing panels (e.g. of a mapped bundle).
+ */
+class PackedMatrix {
+ private:
+  int _rows, _cols;
+  // empty for a view over existing panels
+  std::vector<float> _storage;
+  // first aligned float of the panels
+  const float *_data;
+
+ public:
+
+  /**
+   * packs the given weights
+   * @param w weights matrix or view
+   */
+  explicit PackedMatrix (const MatrixView &w);
+
+  /**
+   * view over existing panels, which must outlive the matrix
+   * @param rows num of rows of the weights
+   * @param cols num of cols of the weights
+   * @param data gemm_packed_size (rows, cols) floats packed by gemm_pack,
+   * GEMM_PACK_ALIGNMENT aligned
+   */
+  PackedMatrix (int rows, int cols, const float *data);
+
+  PackedMatrix (const PackedMatrix &) = delete;
+
+  PackedMatrix &operator= (const PackedMatrix &) = delete;
+
+  /**
+   *
+   * @return num of rows of the weights
+   */
+  int get_rows () const;
+
+  /**
+   *
+   * @return num of cols of the weights
+   */
+  int get_cols () const;
+
+  /**
+   *
+   * @return first element of the panels (see gemm_pack)
+   */
+  const float *data () const;
+
+  /**
+   * out = W * in for n inputs, with the bias / relu epilogue applied
+   * @param in cols x n inputs, stored row by row (one input per column)
+   * @param n number of inputs
+   * @param out receives the rows x n outputs, stored row by row
+   * @param epilogue bias / relu applied on every output
+   */
+  void multiply (const float *in, int n, float *out,
+                 gemm_epilogue epilogue) const;
+
+  /**
+   * out = W * in for a single input, reading only the weight columns of
+   * the listed (non zero) input elements
+   * @param in the input vector
+   * @param nonzeros indexes of the non zero elements of in
+   * @param count number of indexes
+   * @param out receives the rows outputs
+   * @param epilogue bias / relu applied on every output
+   */
+  void multiply_sparse_input (const float *in, const int32_t *nonzeros,
+                              int count, float *out,
+                              gemm_epilogue epilogue) const;
+};
+
+#endif //PACKEDMATRIX_H
@@ -0,0 +1,260 @@
+#include "Quantize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QUANTIZE_X86
+#include <immintrin.h>
+#endif
+
+#define INT8_LIMIT 127
+
+/**
+ * quantizes values with a single scale: value ~= q * scale
+ * @param values floats to quantize
+ * @param stride distance between two values
+ * @param count number of values
+ * @param q receives the int8 values
+ * @return the scale (0 when every value is 0)
+ */
+static float quantize (const float *values, int stride, int count,
+                       int8_t *q) {
+  float max_abs = 0;
+  for (int i = 0; i < count; ++i) {
+    max_abs = std::max (max_abs, std::fabs (values[i * stride]));
+  }
+  if (max_abs == 0) {
+    std::fill (q, q + count, 0);
+    return 0;
+  }
+  float scale = max_abs / INT8_LIMIT;
+  float inverse = 1 / scale;
+  for (int i = 0; i < count; ++i) {
+    float value = std::nearbyint (values[i * stride] * inverse);
+    value = std::min ((float) INT8_LIMIT, std::max (-(float) INT8_LIMIT,
+                                                    value));
+    q[i] = (int8_t) value;
+  }
+  return scale;
+}
+
+/**
+ * portable int8 dot product
+ * @param a first vector
+ * @param b second vector
+ * @param len length of the vectors, a multiple of QUANTIZE_ALIGN
+ * @return the int32 dot product
+ */
+static int32_t dot_generic (const int8_t *a, const int8_t *b, int len) {
+  int32_t sum = 0;
+  for (int k = 0; k < len; ++k) {
+    sum += (int32_t) a[k] * b[k];
+  }
+  return sum;
+}
+
+/**
+ * portable int8 dot products of a vector with QUANTIZE_BLOCK vectors
+ * @param a first vector
+ * @param b the QUANTIZE_BLOCK other vectors, ld apart
+ * @param ld distance between two vectors of b
+ * @param len length of the vectors, a multiple of QUANTIZE_ALIGN
+ * @param sums receives the QUANTIZE_BLOCK int32 dot products
+ */
+static void dot_block_generic (const int8_t *a, const int8_t *b, int ld,
+                               int len, int32_t *sums) {
+  for (int i = 0; i < QUANTIZE_BLOCK; ++i) {
+    sums[i] = dot_generic (a, b + (size_t) i * ld, len);
+  }
+}
+
+#ifdef QUANTIZE_X86
+/**
+ * @param acc eight int32 values
+ * @return the sum of the values
+ */
+__attribute__ ((target ("avx2")))
+static inline int32_t sum_avx2 (__m256i acc) {
+  __m128i sum = _mm_add_epi32 (_mm256_castsi256_si128 (acc),
+                               _mm256_extracti128_si256 (acc, 1));
+  sum = _mm_add_epi32 (sum, _mm_shuffle_epi32 (sum, 0x4e));
+  sum = _mm_add_epi32 (sum, _mm_shuffle_epi32 (sum, 0xb1));
+  return _mm_cvtsi128_si32 (sum);
+}
+
+/**
+ * AVX2 int8 dot product: pmaddubsw needs an unsigned operand, so it takes
+ * |a| and b with the sign of a, then pmaddwd widens the pairs to int32.
+ * @param a first vector
+ * @param b second vector
+ * @param len length of the vectors, a multiple of QUANTIZE_ALIGN
+ * @return the int32 dot product
+ */
+__attribute__ ((target ("avx2")))
+static int32_t dot_avx2 (const int8_t *a, const int8_t *b, int len) {
+  const __m256i ones = _mm256_set1_epi16 (1);
+  __m256i acc = _mm256_setzero_si256 ();
+  for (int k = 0; k < len; k += QUANTIZE_ALIGN) {
+    __m256i va = _mm256_loadu_si256 ((const __m256i *) (a + k));
+    __m256i vb = _mm256_loadu_si256 ((const __m256i *) (b + k));
+    __m256i pairs = _mm256_maddubs_epi16 (_mm256_sign_epi8 (va, va),
+                                          _mm256_sign_epi8 (vb, va));
+    acc = _mm256_add_epi32 (acc, _mm256_madd_epi16 (pairs, ones));
+  }
+  return sum_avx2 (acc);
+}
+
+/**
+ * AVX2 int8 dot products of a vector with QUANTIZE_BLOCK (4) vectors:
+ * every 32 values of a are loaded and made unsigned once for the four
+ * products (see dot_avx2)
+ * @param a first vector
+ * @param b the QUANTIZE_BLOCK other vectors, ld apart
+ * @param ld distance between two vectors of b
+ * @param len length of the vectors, a multiple of QUANTIZE_ALIGN
+ * @param sums receives the QUANTIZE_BLOCK int32 dot products
+ */
+__attribute__ ((target ("avx2")))
+static void dot_block_avx2 (const int8_t *a, const int8_t *b, int ld,
+                            int len, int32_t *sums) {
+  const __m256i ones = _mm256_set1_epi16 (1);
+  const int8_t *b0 = b, *b1 = b + ld, *b2 = b + 2 * ld, *b3 = b + 3 * ld;
+  __m256i acc0 = _mm256_setzero_si256 (), acc1 = _mm256_setzero_si256 ();
+  __m256i acc2 = _mm256_setzero_si256 (), acc3 = _mm256_setzero_si256 ();
+  for (int k = 0; k < len; k += QUANTIZE_ALIGN) {
+    __m256i va = _mm256_loadu_si256 ((const __m256i *) (a + k));
+    __m256i abs_a = _mm256_sign_epi8 (va, va);
+    __m256i v0 = _mm256_loadu_si256 ((const __m256i *) (b0 + k));
+    __m256i v1 = _mm256_loadu_si256 ((const __m256i *) (b1 + k));
+    __m256i v2 = _mm256_loadu_si256 ((const __m256i *) (b2 + k));
+    __m256i v3 = _mm256_loadu_si256 ((const __m256i *) (b3 + k));
+    acc0 = _mm256_add_epi32 (acc0, _mm256_madd_epi16 (
+        _mm256_maddubs_epi16 (abs_a, _mm256_sign_epi8 (v0, va)), ones));
+    acc1 = _mm256_add_epi32 (acc1, _mm256_madd_epi16 (
+        _mm256_maddubs_epi16 (abs_a, _mm256_sign_epi8 (v1, va)), ones));
+    acc2 = _mm256_add_epi32 (acc2, _mm256_madd_epi16 (
+        _mm256_maddubs_epi16 (abs_a, _mm256_sign_epi8 (v2, va)), ones));
+    acc3 = _mm256_add_epi32 (acc3, _mm256_madd_epi16 (
+        _mm256_maddubs_epi16 (abs_a, _mm256_sign_epi8 (v3, va)), ones));
+  }
+  sums[0] = sum_avx2 (acc0);
+  sums[1] = sum_avx2 (acc1);
+  sums[2] = sum_avx2 (acc2);
+  sums[3] = sum_avx2 (acc3);
+}
+#endif
+
+typedef int32_t (*dot_kernel) (const int8_t *, const int8_t *, int);
+
+typedef void (*dot_block_kernel) (const int8_t *, const int8_t *, int, int,
+                                  int32_t *);
+
+/**
+ * Picks the fastest dot product the cpu can run, once.
+ * @return the dot product kernel
+ */
+static dot_kernel select_kernel () {
+#ifdef QUANTIZE_X86
+  if (__builtin_cpu_supports ("avx2")) {
+    return dot_avx2;
+  }
+#endif
+  return dot_generic;
+}
+
+/**
+ * Picks the fastest block of dot products the cpu can run, once.
+ * @return the block kernel
+ */
+static dot_block_kernel select_block_kernel () {
+#ifdef QUANTIZE_X86
+  if (__builtin_cpu_supports ("avx2")) {
+    return dot_block_avx2;
+  }
+#endif
+  return dot_block_generic;
+}
+
+/**
+ * quantizes the given weights
+ * @param w weights matrix or view
+ */
+QuantizedMatrix::QuantizedMatrix (const MatrixView &w)
+    : _rows (w.get_rows ()), _cols (w.get_cols ()),
+      _ld ((w.get_cols () + QUANTIZE_ALIGN - 1) / QUANTIZE_ALIGN
+           * QUANTIZE_ALIGN),
+      _weights ((size_t) _rows * _ld, 0), _scales (_rows) {
+  for (int r = 0; r < _rows; ++r) {
+    _scales[r] = quantize (w.data () + (size_t) r * w.row_stride (),
+                           w.col_stride (), _cols,
+                           _weights.data () + (size_t) r * _ld);
+  }
+}
+
+/**
+ *
+ * @return num of rows of the weights
+ */
+int QuantizedMatrix::get_rows () const {
+  return _rows;
+}
+
+/**
+ *
+ * @return num of cols of the weights
+ */
+int QuantizedMatrix::get_cols () const {
+  return _cols;
+}
+
+/**
+ * out = W * in for n inputs, with the bias / relu epilogue applied
+ * @param in cols x n inputs, stored row by row (one input per column)
+ * @param n number of inputs
+ * @param out receives the rows x n outputs, stored row by row
+ * @param epilogue bias / relu applied on every output
+ */
+void QuantizedMatrix::multiply (const float *in, int n, float *out,
+                                gemm_epilogue epilogue) const {
+  static const dot_kernel dot = select_kernel ();
+  static const dot_block_kernel dot_block = select_block_kernel ();
+  // the quantized inputs are reused by all the products of the thread
+  static thread_local std::vector<int8_t> inputs;
+  if (inputs.size () < (size_t) QUANTIZE_BLOCK * _ld) {
+    inputs.resize ((size_t) QUANTIZE_BLOCK * _ld);
+  }
+  float input_scales[QUANTIZE_BLOCK];
+  int32_t sums[QUANTIZE_BLOCK];
+  for (int j0 = 0; j0 < n; j0 += QUANTIZE_BLOCK) {
+    int count = std::min (QUANTIZE_BLOCK, n - j0);
+    for (int j = 0; j < count; ++j) {
+      int8_t *input = inputs.data () + (size_t) j * _ld;
+      input_scales[j] = quantize (in + j0 + j, n, _cols, input);
+      // the buffer may hold the longer inputs of another product
+      std::memset (input + _cols, 0, _ld - _cols);
+    }
+    for (int r = 0; r < _rows; ++r) {
+      const int8_t *weights = _weights.data () + (size_t) r * _ld;
+      if (count == QUANTIZE_BLOCK) {
+        dot_block (weights, inputs.data (), _ld, _ld, sums);
+      }
+      else {
+        for (int j = 0; j < count; ++j) {
+          sums[j] = dot (weights, inputs.data () + (size_t) j * _ld, _ld);
+        }
+      }
+      for (int j = 0; j < count; ++j) {
+        float value = (float) sums[j] * _scales[r] * input_scales[j];
+        if (epilogue.bias != nullptr) {
+          value += epilogue.bias[r];
+        }
+        if (epilogue.relu && value < 0) {
+          value = 0;
+        }
+        out[(size_t) r * n + j0 + j] = value;
+      }
+    }
+  }
+}
@@ -0,0 +1,71 @@
+// Quantize.h
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include "Gemm.h"
+#include "MatrixView.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Rows of the int8 copy are padded with zeros to a multiple of this, so
+ * the kernels never need a tail loop.
+ */
+#define QUANTIZE_ALIGN 32
+
+/**
+ * Number of quantized inputs a pass over the weight rows multiplies, each
+ * int8 weight row is loaded once for all of them.
+ */
+#define QUANTIZE_BLOCK 4
+
+/**
+ * An int8 copy of a weight matrix with one scale per output row:
+ * W(r, k) ~= q(r, k) * scale[r], q in [-127, 127].
+ * Products quantize every input vector to int8 on the fly (one scale per
+ * vector), accumulate in int32 and rescale to float at the end. Batches
+ * are multiplied QUANTIZE_BLOCK inputs per pass over the rows. The AVX2
+ * kernel multiplies with pmaddubsw (|q| times the sign corrected input,
+ * which can not saturate for |q| <= 127), a scalar kernel is used on
+ * other cpus.
+ */
+class QuantizedMatrix {
+
+ private:
+  int _rows, _cols, _ld;
+  std::vector<int8_t> _weights;
+  std::vector<float> _scales;
+
+ public:
+
+  /**
+   * quantizes the given weights
+   * @param w weights matrix or view
+   */
+  explicit QuantizedMatrix (const MatrixView &w);
+
+  /**
+   *
+   * @return num of rows of the weights
+   */
+  int get_rows () const;
+
+  /**
+   *
+   * @return num of cols of the weights
+   */
+  int get_cols () const;
+
+  /**
+   * out = W * in for n inputs, with the bias / relu epilogue applied
+   * @param in cols x n inputs, stored row by row (one input per column)
+   * @param n number of inputs
+   * @param out receives the rows x n outputs, stored row by row
+   * @param epilogue bias / relu applied on every output
+   */
+  void multiply (const float *in, int n, float *out,
+                 gemm_epilogue epilogue) const;
+};
+
+#endif //QUANTIZE_H
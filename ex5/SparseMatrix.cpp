@@ -0,0 +1,326 @@
+#include "SparseMatrix.h"
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPARSE_X86
+#include <immintrin.h>
+#endif
+
+#define SPARSE_LANES 8
+
+/**
+ * bias and relu of one output
+ * @param value product of the output
+ * @param row row of the output
+ * @param epilogue bias / relu to apply
+ * @return the output
+ */
+static inline float finish (float value, int row, gemm_epilogue epilogue) {
+  if (epilogue.bias != nullptr) {
+    value += epilogue.bias[row];
+  }
+  if (epilogue.relu && value < 0) {
+    value = 0;
+  }
+  return value;
+}
+
+/**
+ * portable product: a sparse row times a vector is a dot product over
+ * the stored weights, for a batch every stored weight scales a whole
+ * (contiguous) input row into the output row
+ * @param w sparse weights
+ * @param in cols x n inputs, stored row by row
+ * @param n number of inputs
+ * @param out receives the rows x n outputs, stored row by row
+ * @param epilogue bias / relu applied on every output
+ */
+static void multiply_generic (const SparseMatrix &w, const float *in, int n,
+                              float *out, gemm_epilogue epilogue) {
+  const int32_t *offsets = w.offsets ();
+  const int32_t *columns = w.columns ();
+  const float *values = w.values ();
+  for (int r = 0; r < w.get_rows (); ++r) {
+    float *row = out + (size_t) r * n;
+    if (n == 1) {
+      float sum = 0;
+      for (int32_t k = offsets[r]; k < offsets[r + 1]; ++k) {
+        sum += values[k] * in[columns[k]];
+      }
+      row[0] = finish (sum, r, epilogue);
+      continue;
+    }
+    for (int j = 0; j < n; ++j) {
+      row[j] = 0;
+    }
+    for (int32_t k = offsets[r]; k < offsets[r + 1]; ++k) {
+      const float *input = in + (size_t) columns[k] * n;
+      float value = values[k];
+      for (int j = 0; j < n; ++j) {
+        row[j] += value * input[j];
+      }
+    }
+    for (int j = 0; j < n; ++j) {
+      row[j] = finish (row[j], r, epilogue);
+    }
+  }
+}
+
+#ifdef SPARSE_X86
+/**
+ * sums the eight lanes of a register
+ * @param v the register
+ * @return the sum
+ */
+__attribute__ ((target ("avx2")))
+static inline float horizontal_sum (__m256 v) {
+  __m128 sum = _mm_add_ps (_mm256_castps256_ps128 (v),
+                           _mm256_extractf128_ps (v, 1));
+  sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+  sum = _mm_add_ss (sum, _mm_movehdup_ps (sum));
+  return _mm_cvtss_f32 (sum);
+}
+
+/**
+ * bias and relu of eight outputs of one row
+ * @param v products of the outputs
+ * @param row row of the outputs
+ * @param epilogue bias / relu to apply
+ * @return the outputs
+ */
+__attribute__ ((target ("avx2")))
+static inline __m256 finish_avx2 (__m256 v, int row, gemm_epilogue epilogue) {
+  if (epilogue.bias != nullptr) {
+    v = _mm256_add_ps (v, _mm256_set1_ps (epilogue.bias[row]));
+  }
+  if (epilogue.relu) {
+    v = _mm256_max_ps (v, _mm256_setzero_ps ());
+  }
+  return v;
+}
+
+/**
+ * AVX2 sparse row times vector: the inputs of eight stored weights are
+ * gathered by their columns, two independent accumulators
+ * @param values stored weights of the row
+ * @param columns their columns
+ * @param count number of stored weights
+ * @param in the input vector
+ * @return the dot product
+ */
+__attribute__ ((target ("avx2,fma")))
+static float sparse_dot_avx2 (const float *values, const int32_t *columns,
+                              int32_t count, const float *in) {
+  __m256 acc0 = _mm256_setzero_ps (), acc1 = _mm256_setzero_ps ();
+  int32_t k = 0;
+  for (; k + 2 * SPARSE_LANES <= count; k += 2 * SPARSE_LANES) {
+    __m256i c0 = _mm256_loadu_si256 ((const __m256i *) (columns + k));
+    __m256i c1 = _mm256_loadu_si256 (
+        (const __m256i *) (columns + k + SPARSE_LANES));
+    acc0 = _mm256_fmadd_ps (_mm256_loadu_ps (values + k),
+                            _mm256_i32gather_ps (in, c0, sizeof (float)),
+                            acc0);
+    acc1 = _mm256_fmadd_ps (_mm256_loadu_ps (values + k + SPARSE_LANES),
+                            _mm256_i32gather_ps (in, c1, sizeof (float)),
+                            acc1);
+  }
+  float sum = horizontal_sum (_mm256_add_ps (acc0, acc1));
+  for (; k < count; ++k) {
+    sum += values[k] * in[columns[k]];
+  }
+  return sum;
+}
+
+/**
+ * AVX2 product: single vectors use sparse_dot_avx2, batches keep 32 (then
+ * 8) outputs of a row in registers while every stored weight of the row is
+ * broadcast and multiplied with its input row
+ * @param w sparse weights
+ * @param in cols x n inputs, stored row by row
+ * @param n number of inputs
+ * @param out receives the rows x n outputs, stored row by row
+ * @param epilogue bias / relu applied on every output
+ */
+__attribute__ ((target ("avx2,fma")))
+static void multiply_avx2 (const SparseMatrix &w, const float *in, int n,
+                           float *out, gemm_epilogue epilogue) {
+  const int32_t *offsets = w.offsets ();
+  const int32_t *columns = w.columns ();
+  const float *values = w.values ();
+  for (int r = 0; r < w.get_rows (); ++r) {
+    int32_t begin = offsets[r], end = offsets[r + 1];
+    float *row = out + (size_t) r * n;
+    if (n == 1) {
+      row[0] = finish (sparse_dot_avx2 (values + begin, columns + begin,
+                                        end - begin, in), r, epilogue);
+      continue;
+    }
+    int j = 0;
+    for (; j + 4 * SPARSE_LANES <= n; j += 4 * SPARSE_LANES) {
+      __m256 acc0 = _mm256_setzero_ps (), acc1 = _mm256_setzero_ps ();
+      __m256 acc2 = _mm256_setzero_ps (), acc3 = _mm256_setzero_ps ();
+      for (int32_t k = begin; k < end; ++k) {
+        const float *input = in + (size_t) columns[k] * n + j;
+        __m256 value = _mm256_broadcast_ss (values + k);
+        acc0 = _mm256_fmadd_ps (value, _mm256_loadu_ps (input), acc0);
+        acc1 = _mm256_fmadd_ps (value,
+                                _mm256_loadu_ps (input + SPARSE_LANES), acc1);
+        acc2 = _mm256_fmadd_ps (value,
+                                _mm256_loadu_ps (input + 2 * SPARSE_LANES),
+                                acc2);
+        acc3 = _mm256_fmadd_ps (value,
+                                _mm256_loadu_ps (input + 3 * SPARSE_LANES),
+                                acc3);
+      }
+      _mm256_storeu_ps (row + j, finish_avx2 (acc0, r, epilogue));
+      _mm256_storeu_ps (row + j + SPARSE_LANES,
+                        finish_avx2 (acc1, r, epilogue));
+      _mm256_storeu_ps (row + j + 2 * SPARSE_LANES,
+                        finish_avx2 (acc2, r, epilogue));
+      _mm256_storeu_ps (row + j + 3 * SPARSE_LANES,
+                        finish_avx2 (acc3, r, epilogue));
+    }
+    for (; j + SPARSE_LANES <= n; j += SPARSE_LANES) {
+      __m256 acc = _mm256_setzero_ps ();
+      for (int32_t k = begin; k < end; ++k) {
+        acc = _mm256_fmadd_ps (
+            _mm256_broadcast_ss (values + k),
+            _mm256_loadu_ps (in + (size_t) columns[k] * n + j), acc);
+      }
+      _mm256_storeu_ps (row + j, finish_avx2 (acc, r, epilogue));
+    }
+    for (; j < n; ++j) {
+      float sum = 0;
+      for (int32_t k = begin; k < end; ++k) {
+        sum += values[k] * in[(size_t) columns[k] * n + j];
+      }
+      row[j] = finish (sum, r, epilogue);
+    }
+  }
+}
+#endif
+
+typedef void (*sparse_kernel) (const SparseMatrix &, const float *, int,
+                               float *, gemm_epilogue);
+
+/**
+ * Picks the fastest sparse product the cpu can run, once.
+ * @return the product kernel
+ */
+static sparse_kernel select_kernel () {
+#ifdef SPARSE_X86
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma")) {
+    return multiply_avx2;
+  }
+#endif
+  return multiply_generic;
+}
+
+/**
+ * converts the given weights, dropping every weight whose absolute value
+ * is at most threshold
+ * @param w weights matrix or view
+ * @param threshold largest absolute value to drop
+ */
+SparseMatrix::SparseMatrix (const MatrixView &w, float threshold)
+    : _rows (w.get_rows ()), _cols (w.get_cols ()),
+      _owned_offsets (w.get_rows () + 1) {
+  for (int r = 0; r < _rows; ++r) {
+    _owned_offsets[r] = (int32_t) _owned_values.size ();
+    for (int c = 0; c < _cols; ++c) {
+      float value = w (r, c);
+      if (std::fabs (value) > threshold) {
+        _owned_columns.push_back (c);
+        _owned_values.push_back (value);
+      }
+    }
+  }
+  _owned_offsets[_rows] = (int32_t) _owned_values.size ();
+  _offsets = _owned_offsets.data ();
+  _columns = _owned_columns.data ();
+  _values = _owned_values.data ();
+}
+
+/**
+ * view over existing arrays, which must outlive the matrix
+ * @param rows num of rows
+ * @param cols num of cols
+ * @param offsets rows + 1 offsets of the rows in columns and values
+ * @param columns column of every non zero weight
+ * @param values every non zero weight
+ */
+SparseMatrix::SparseMatrix (int rows, int cols, const int32_t *offsets,
+                            const int32_t *columns, const float *values)
+    : _rows (rows), _cols (cols), _offsets (offsets), _columns (columns),
+      _values (values) {
+}
+
+/**
+ *
+ * @return num of rows of the weights
+ */
+int SparseMatrix::get_rows () const {
+  return _rows;
+}
+
+/**
+ *
+ * @return num of cols of the weights
+ */
+int SparseMatrix::get_cols () const {
+  return _cols;
+}
+
+/**
+ *
+ * @return number of stored (non zero) weights
+ */
+int64_t SparseMatrix::nonzeros () const {
+  return _offsets[_rows];
+}
+
+/**
+ *
+ * @return fraction of the weights that are stored
+ */
+float SparseMatrix::density () const {
+  return (float) nonzeros () / ((float) _rows * _cols);
+}
+
+/**
+ *
+ * @return rows + 1 offsets of the rows in columns () and values ()
+ */
+const int32_t *SparseMatrix::offsets () const {
+  return _offsets;
+}
+
+/**
+ *
+ * @return column of every stored weight
+ */
+const int32_t *SparseMatrix::columns () const {
+  return _columns;
+}
+
+/**
+ *
+ * @return every stored weight
+ */
+const float *SparseMatrix::values () const {
+  return _values;
+}
+
+/**
+ * out = W * in for n inputs, with the bias / relu epilogue applied
+ * @param in cols x n inputs, stored row by row (one input per column)
+ * @param n number of inputs
+ * @param out receives the rows x n outputs, stored row by row
+ * @param epilogue bias / relu applied on every output
+ */
+void SparseMatrix::multiply (const float *in, int n, float *out,
+                             gemm_epilogue epilogue) const {
+  static const sparse_kernel kernel = select_kernel ();
+  kernel (*this, in, n, out, epilogue);
+}
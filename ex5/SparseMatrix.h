@@ -0,0 +1,112 @@
+// SparseMatrix.h
+#ifndef SPARSEMATRIX_H
+#define SPARSEMATRIX_H
+
+#include "Gemm.h"
+#include "MatrixView.h"
+
+#include <cstdint>
+#include <vector>
+
+// densest weights worth storing sparse: above it (a column index per
+// weight) the sparse matrix is larger than the dense one, and batches run
+// no faster than the dense products
+#define SPARSE_MAX_DENSITY 0.5f
+
+/**
+ * A weight matrix in compressed sparse row (CSR) form: only the non zero
+ * weights are stored, row after row, with their column. The products
+ * skip the zeros, so a matrix pruned to 10% density costs about a tenth
+ * of the multiplications and a fifth of the bytes of the dense one.
+ * The matrix either owns its arrays (converted from a float matrix) or
+ * is a view over existing ones (e.g. a mapped model bundle).
+ */
+class SparseMatrix {
+ private:
+  int _rows, _cols;
+  std::vector<int32_t> _owned_offsets, _owned_columns;
+  std::vector<float> _owned_values;
+  // the non zeros of row r are [_offsets[r], _offsets[r + 1])
+  const int32_t *_offsets;
+  const int32_t *_columns;
+  const float *_values;
+
+ public:
+
+  /**
+   * converts the given weights, dropping every weight whose absolute value
+   * is at most threshold (only the zeros for threshold 0)
+   * @param w weights matrix or view
+   * @param threshold largest absolute value to drop
+   */
+  explicit SparseMatrix (const MatrixView &w, float threshold = 0);
+
+  /**
+   * view over existing arrays, which must outlive the matrix
+   * @param rows num of rows
+   * @param cols num of cols
+   * @param offsets rows + 1 offsets of the rows in columns and values
+   * @param columns column of every non zero weight
+   * @param values every non zero weight
+   */
+  SparseMatrix (int rows, int cols, const int32_t *offsets,
+                const int32_t *columns, const float *values);
+
+  SparseMatrix (const SparseMatrix &) = delete;
+
+  SparseMatrix &operator= (const SparseMatrix &) = delete;
+
+  /**
+   *
+   * @return num of rows of the weights
+   */
+  int get_rows () const;
+
+  /**
+   *
+   * @return num of cols of the weights
+   */
+  int get_cols () const;
+
+  /**
+   *
+   * @return number of stored (non zero) weights
+   */
+  int64_t nonzeros () const;
+
+  /**
+   *
+   * @return fraction of the weights that are stored
+   */
+  float density () const;
+
+  /**
+   *
+   * @return rows + 1 offsets of the rows in columns () and values ()
+   */
+  const int32_t *offsets () const;
+
+  /**
+   *
+   * @return column of every stored weight
+   */
+  const int32_t *columns () const;
+
+  /**
+   *
+   * @return every stored weight
+   */
+  const float *values () const;
+
+  /**
+   * out = W * in for n inputs, with the bias / relu epilogue applied
+   * @param in cols x n inputs, stored row by row (one input per column)
+   * @param n number of inputs
+   * @param out receives the rows x n outputs, stored row by row
+   * @param epilogue bias / relu applied on every output
+   */
+  void multiply (const float *in, int n, float *out,
+                 gemm_epilogue epilogue) const;
+};
+
+#endif //SPARSEMATRIX_H
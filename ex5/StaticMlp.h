@@ -0,0 +1,265 @@
+// StaticMlp.h
+#ifndef STATICMLP_H
+#define STATICMLP_H
+
+#include "ActivationKernels.h"
+#include "Digit.h"
+#include "Matrix.h"
+
+#include <array>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STATIC_X86
+#include <immintrin.h>
+#endif
+
+// floats of a SIMD register, partial sums of every dot product
+#define STATIC_LANES 8
+
+/**
+ * Rows dot products of consecutive weight rows with the input, portable
+ * loops. Every dot product keeps STATIC_LANES independent partial sums, so
+ * the constant trip count loop can be unrolled and vectorized without
+ * reordering float additions at -O2.
+ * @tparam In input width (length of every row)
+ * @tparam Rows number of rows
+ * @param w first row, rows stored one after the other
+ * @param x input vector
+ * @param y receives the Rows dot products
+ */
+template<int In, int Rows>
+inline void static_dot_generic (const float *w, const float *x, float *y) {
+  for (int r = 0; r < Rows; ++r) {
+    const float *row = w + r * In;
+    float lanes[STATIC_LANES] = {0};
+    const int full = In - In % STATIC_LANES;
+    for (int k = 0; k < full; k += STATIC_LANES) {
+      for (int l = 0; l < STATIC_LANES; ++l) {
+        lanes[l] += row[k + l] * x[k + l];
+      }
+    }
+    for (int k = full; k < In; ++k) {
+      lanes[0] += row[k] * x[k];
+    }
+    float acc = 0;
+    for (int l = 0; l < STATIC_LANES; ++l) {
+      acc += lanes[l];
+    }
+    y[r] = acc;
+  }
+}
+
+#ifdef STATIC_X86
+/**
+ * Dot product of one weight row with the input, AVX2/FMA: four
+ * independent accumulators hide the latency of the fused multiply-adds,
+ * the row streams in order.
+ * @tparam In input width (length of the row)
+ * @param row the weight row
+ * @param x input vector
+ * @return the dot product
+ */
+template<int In>
+__attribute__ ((target ("avx2,fma")))
+inline float static_dot_avx2 (const float *row, const float *x) {
+  const int blocks = In - In % (4 * STATIC_LANES);
+  const int full = In - In % STATIC_LANES;
+  __m256 acc0 = _mm256_setzero_ps (), acc1 = _mm256_setzero_ps ();
+  __m256 acc2 = _mm256_setzero_ps (), acc3 = _mm256_setzero_ps ();
+  for (int k = 0; k < blocks; k += 4 * STATIC_LANES) {
+    acc0 = _mm256_fmadd_ps (_mm256_loadu_ps (row + k),
+                            _mm256_loadu_ps (x + k), acc0);
+    acc1 = _mm256_fmadd_ps (_mm256_loadu_ps (row + k + 8),
+                            _mm256_loadu_ps (x + k + 8), acc1);
+    acc2 = _mm256_fmadd_ps (_mm256_loadu_ps (row + k + 16),
+                            _mm256_loadu_ps (x + k + 16), acc2);
+    acc3 = _mm256_fmadd_ps (_mm256_loadu_ps (row + k + 24),
+                            _mm256_loadu_ps (x + k + 24), acc3);
+  }
+  for (int k = blocks; k < full; k += STATIC_LANES) {
+    acc0 = _mm256_fmadd_ps (_mm256_loadu_ps (row + k),
+                            _mm256_loadu_ps (x + k), acc0);
+  }
+  acc0 = _mm256_add_ps (_mm256_add_ps (acc0, acc1),
+                        _mm256_add_ps (acc2, acc3));
+  __m128 sum = _mm_add_ps (_mm256_castps256_ps128 (acc0),
+                           _mm256_extractf128_ps (acc0, 1));
+  sum = _mm_hadd_ps (sum, sum);
+  sum = _mm_hadd_ps (sum, sum);
+  float dot = _mm_cvtss_f32 (sum);
+  for (int k = full; k < In; ++k) {
+    dot += row[k] * x[k];
+  }
+  return dot;
+}
+
+/**
+ * The weight product of a layer, AVX2/FMA, one row after the other
+ * @tparam In input width
+ * @tparam Out output width
+ * @param w weights of the layer
+ * @param x input vector
+ * @param y receives W * x
+ */
+template<int In, int Out>
+__attribute__ ((target ("avx2,fma")))
+void static_product_avx2 (const float *w, const float *x, float *y) {
+  for (int r = 0; r < Out; ++r) {
+    y[r] = static_dot_avx2<In> (w + r * In, x);
+  }
+}
+
+/**
+ *
+ * @return true if the cpu runs the AVX2/FMA kernels, checked once
+ */
+inline bool static_has_avx2 () {
+  static const bool has = __builtin_cpu_supports ("avx2")
+                          && __builtin_cpu_supports ("fma");
+  return has;
+}
+#endif
+
+/**
+ * One dense layer with compile time widths: y = act(W * x + b), W is
+ * Out x In stored row by row. Every loop bound is a template parameter,
+ * so each layer gets its own unrolled kernel (the AVX2/FMA one when the
+ * cpu has it). The output layer runs the softmax of ActivationKernels.h,
+ * the one MlpNetwork runs.
+ * @tparam In input width
+ * @tparam Out output width
+ * @tparam Last true for the output layer (softmax), false for relu
+ * @param w weights of the layer
+ * @param b bias of the layer
+ * @param x input vector
+ * @param y output vector
+ */
+template<int In, int Out, bool Last>
+inline void static_dense (const float *w, const float *b, const float *x,
+                          std::array<float, Out> &y) {
+#ifdef STATIC_X86
+  if (static_has_avx2 ()) {
+    static_product_avx2<In, Out> (w, x, y.data ());
+  }
+  else {
+    static_dot_generic<In, Out> (w, x, y.data ());
+  }
+#else
+  static_dot_generic<In, Out> (w, x, y.data ());
+#endif
+  for (int r = 0; r < Out; ++r) {
+    float acc = y[r] + b[r];
+    y[r] = (Last || acc > 0) ? acc : 0;
+  }
+  if (Last) {
+    apply_softmax (y.data (), Out, 1, 1);
+  }
+}
+
+/**
+ * Runs the layers from Layer on, every activation vector is a std::array
+ * on the stack of its own layer.
+ * @tparam Layer index of the first layer to run
+ * @tparam In input width of that layer
+ * @tparam Out output width of that layer
+ * @tparam Rest output widths of the following layers
+ */
+template<int Layer, int In, int Out, int... Rest>
+struct static_forward {
+  static digit run (const float *const *weights, const float *const *biases,
+                    const float *x) {
+    std::array<float, Out> y;
+    static_dense<In, Out, false> (weights[Layer], biases[Layer], x, y);
+    return static_forward<Layer + 1, Out, Rest...>::run (weights, biases,
+                                                        y.data ());
+  }
+};
+
+/**
+ * The output layer: softmax, then the most probable digit.
+ */
+template<int Layer, int In, int Out>
+struct static_forward<Layer, In, Out> {
+  static digit run (const float *const *weights, const float *const *biases,
+                    const float *x) {
+    std::array<float, Out> y;
+    static_dense<In, Out, true> (weights[Layer], biases[Layer], x, y);
+    unsigned int index = 0;
+    for (int j = 1; j < Out; ++j) {
+      if (y[index] < y[j]) {
+        index = j;
+      }
+    }
+    digit digit = {index, y[index]};
+    return digit;
+  }
+};
+
+/**
+ * An mlp network whose widths are template parameters, e.g.
+ * StaticMlp<784, 128, 64, 20, 10> (input width, then the width of every
+ * layer). Hidden layers use relu and the last one softmax.
+ * The network refers to the weights without copying them, inference
+ * keeps every activation on the stack and does no heap allocation and no
+ * dimension check: dims are checked once, by the constructor.
+ * @tparam Input width of the input
+ * @tparam Widths width of every layer
+ */
+template<int Input, int... Widths>
+class StaticMlp {
+
+ private:
+  static const int _layer_count = sizeof... (Widths);
+  std::array<const float *, sizeof... (Widths)> _weights, _biases;
+
+ public:
+
+  /**
+   * constructor of class, exits (code == 1) if the parameters do not have
+   * the dims of the template or have padded rows
+   * @tparam M Matrix or MatrixView
+   * @param weights weights[i] is the i'th layer weights matrix
+   * @param biases biases[i] is the i'th layer bias vector
+   */
+  template<class M>
+  StaticMlp (const M *weights, const M *biases) {
+    const int widths[] = {Input, Widths...};
+    for (int i = 0; i < _layer_count; ++i) {
+      if (weights[i].get_rows () != widths[i + 1]
+          || weights[i].get_cols () != widths[i]
+          || biases[i].get_rows () * biases[i].get_cols () != widths[i + 1]
+          || !weights[i].is_contiguous () || !biases[i].is_contiguous ()) {
+        std::cerr << "Error: the parameters of layer " << (i + 1)
+                  << " do not fit the network" << std::endl;
+        exit (EXIT_FAILURE);
+      }
+      _weights[i] = weights[i].data ();
+      _biases[i] = biases[i].data ();
+    }
+  }
+
+  /**
+   * Applies the entire network on input returns digit struct
+   * @param img Input floats
+   * @return
+   */
+  digit operator() (const float *img) const {
+    return static_forward<0, Input, Widths...>::run (_weights.data (),
+                                                     _biases.data (), img);
+  }
+
+  /**
+   * Applies the entire network on input returns digit struct
+   * @param img matrix of Input elements, without padded rows
+   * @return
+   */
+  digit operator() (const Matrix &img) const {
+    if (img.get_rows () * img.get_cols () != Input || !img.is_contiguous ()) {
+      std::cerr << "Error: invalid image size" << std::endl;
+      exit (EXIT_FAILURE);
+    }
+    return (*this) (img.data ());
+  }
+};
+
+#endif //STATICMLP_H
@@ -0,0 +1,129 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * Pins a thread to a single cpu, does nothing where that is not supported
+ * @param thread the thread
+ * @param cpu index of the cpu, taken modulo the number of cpus
+ */
+static void pin_thread (std::thread &thread, int cpu) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO (&set);
+  CPU_SET (cpu % std::max (1u, std::thread::hardware_concurrency ()), &set);
+  pthread_setaffinity_np (thread.native_handle (), sizeof (set), &set);
+#else
+  (void) thread;
+  (void) cpu;
+#endif
+}
+
+/**
+ * starts the workers
+ * @param threads number of workers, 0 for one per hardware thread
+ * @param pin true to pin worker i to cpu i
+ */
+ThreadPool::ThreadPool (int threads, bool pin)
+    : _body (nullptr), _count (0), _chunk (1), _next (0), _busy (0),
+      _generation (0), _stop (false) {
+  if (threads <= 0) {
+    threads = (int) std::max (1u, std::thread::hardware_concurrency ());
+  }
+  _threads.reserve (threads);
+  for (int i = 0; i < threads; ++i) {
+    _threads.emplace_back (&ThreadPool::work, this, i);
+    if (pin) {
+      pin_thread (_threads.back (), i);
+    }
+  }
+}
+
+/**
+ * destructor of class, joins the workers
+ */
+ThreadPool::~ThreadPool () {
+  {
+    std::lock_guard<std::mutex> lock (_mutex);
+    _stop = true;
+  }
+  _wake.notify_all ();
+  for (std::thread &thread : _threads) {
+    thread.join ();
+  }
+}
+
+/**
+ *
+ * @return number of workers
+ */
+int ThreadPool::size () const {
+  return (int) _threads.size ();
+}
+
+/**
+ * runs chunks of the current loop until none is left
+ * @param worker index of the worker
+ */
+void ThreadPool::run_chunks (int worker) {
+  std::unique_lock<std::mutex> lock (_mutex);
+  while (_next < _count) {
+    int begin = _next;
+    int end = std::min (_count, begin + _chunk);
+    _next = end;
+    lock.unlock ();
+    (*_body) (worker, begin, end);
+    lock.lock ();
+  }
+}
+
+/**
+ * worker thread main loop
+ * @param worker index of the worker
+ */
+void ThreadPool::work (int worker) {
+  unsigned long seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock (_mutex);
+      _wake.wait (lock, [&] { return _stop || _generation != seen; });
+      if (_stop) {
+        return;
+      }
+      seen = _generation;
+    }
+    run_chunks (worker);
+    std::lock_guard<std::mutex> lock (_mutex);
+    if (--_busy == 0) {
+      _done.notify_one ();
+    }
+  }
+}
+
+/**
+ * Splits [0, count) into chunks and runs body on them in parallel,
+ * returns when every chunk is done
+ * @param count number of indices
+ * @param chunk largest range given to one call of body
+ * @param body the loop body
+ */
+void ThreadPool::parallel_for (int count, int chunk, const loop_body &body) {
+  if (count <= 0) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock (_mutex);
+  _body = &body;
+  _count = count;
+  _chunk = std::max (1, chunk);
+  _next = 0;
+  _busy = size ();
+  ++_generation;
+  _wake.notify_all ();
+  _done.wait (lock, [&] { return _busy == 0; });
+  _body = nullptr;
+}
@@ -0,0 +1,84 @@
+// ThreadPool.h
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of worker threads that run one parallel loop at a time.
+ * The workers sleep between loops, so a pool is created once and reused
+ * for every batch. Worker i can be pinned to cpu i (modulo the number of
+ * cpus) so its caches and memory stay local.
+ */
+class ThreadPool {
+
+ public:
+  /**
+   * body of a parallel loop, called with the worker running it and the
+   * range [begin, end) of indices it handles
+   */
+  typedef std::function<void (int worker, int begin, int end)> loop_body;
+
+ private:
+  std::vector<std::thread> _threads;
+  std::mutex _mutex;
+  std::condition_variable _wake, _done;
+  const loop_body *_body;
+  int _count, _chunk, _next;
+  // workers still inside the current loop
+  int _busy;
+  // incremented for every loop, workers wait for a new one
+  unsigned long _generation;
+  bool _stop;
+
+  /**
+   * worker thread main loop
+   * @param worker index of the worker
+   */
+  void work (int worker);
+
+  /**
+   * runs chunks of the current loop until none is left
+   * @param worker index of the worker
+   */
+  void run_chunks (int worker);
+
+ public:
+
+  /**
+   * starts the workers
+   * @param threads number of workers, 0 for one per hardware thread
+   * @param pin true to pin worker i to cpu i
+   */
+  explicit ThreadPool (int threads = 0, bool pin = false);
+
+  ThreadPool (const ThreadPool &) = delete;
+  ThreadPool &operator= (const ThreadPool &) = delete;
+
+  /**
+   * destructor of class, joins the workers
+   */
+  ~ThreadPool ();
+
+  /**
+   *
+   * @return number of workers
+   */
+  int size () const;
+
+  /**
+   * Splits [0, count) into chunks of at most chunk indices and runs body
+   * on them in parallel, returns when every chunk is done. The calling
+   * thread waits, it does not run chunks itself.
+   * @param count number of indices
+   * @param chunk largest range given to one call of body
+   * @param body the loop body
+   */
+  void parallel_for (int count, int chunk, const loop_body &body);
+};
+
+#endif //THREADPOOL_H
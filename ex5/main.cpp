@@ -1,26 +1,157 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "Matrix.h"
+#include "MatrixView.h"
 #include "Activation.h"
 #include "Dense.h"
 #include "MlpNetwork.h"
+#include "MappedFile.h"
+#include "ModelBundle.h"
+#include "StaticMlp.h"
+#include "BatchEngine.h"
+#include "ImagePrefetcher.h"
+#include "AllocCounter.h"
 
 #define QUIT "q"
 #define INSERT_IMAGE_PATH "Please insert image path:"
 #define ERROR_INAVLID_PARAMETER "Error: invalid Parameters file for layer: "
 #define ERROR_INVALID_INPUT "Error: Failed to retrieve input. Exiting.."
 #define ERROR_INVALID_IMG "Error: invalid image path or size: "
+#define ERROR_INVALID_BUNDLE "Error: invalid model bundle: "
+#define ERROR_WRITE_BUNDLE "Error: failed to write model bundle: "
+#define ERROR_INVALID_NETWORK "Error: the network input must be an image of "
+#define ERROR_INVALID_LABELS "Error: invalid labeled images file: "
+#define ERROR_FLOAT_WEIGHTS "Error: this needs a model with float weights"
+#define ERROR_INVALID_BULK "Error: invalid images manifest or directory: "
+#define ERROR_STREAM_READ "Error: failed to read the frames stream"
+#define ERROR_PARTIAL_FRAME "Error: the stream ended inside a frame"
+#define ERROR_SPARSE_PRECISION "Error: sparse layers run in f32 precision"
+#define ERROR_NO_ALLOC_COUNTING "Error: allocation counting needs a build " \
+                                "with MLP_COUNT_ALLOCS"
 #define USAGE_MSG "Usage:\n" \
-                  "\t./mlpnetwork w1 w2 w3 w4 b1 b2 b3 b4\n" \
+                  "\t./mlpnetwork [options] w1 w2 w3 w4 b1 b2 b3 b4\n" \
+                  "\t./mlpnetwork model\n" \
                   "\twi - the i'th layer's weights\n" \
-                  "\tbi - the i'th layer's biases"
+                  "\tbi - the i'th layer's biases\n" \
+                  "\tmodel - a model bundle\n" \
+                  "Options:\n" \
+                  "\t--topology n0,n1,...,nL - input width and width of " \
+                  "every layer\n" \
+                  "\t\t(default 784,128,64,20,10), L layers take L weights " \
+                  "and L biases\n" \
+                  "\t--activations a1,...,aL - relu, softmax, sigmoid, tanh " \
+                  "or gelu per layer\n" \
+                  "\t\t(default relu for all but the last, softmax)\n" \
+                  "\t--pack model - write the parameters into a model " \
+                  "bundle and exit\n" \
+                  "\t--precision f32|int8|fp16|bf16 - weights storage of " \
+                  "the products\n" \
+                  "\t\t(default f32), with --pack the weights type of the " \
+                  "bundle\n" \
+                  "\t--sparse threshold - drop the weights of absolute " \
+                  "value at most threshold\n" \
+                  "\t\tand run the layers left sparse enough on CSR " \
+                  "weights, with --pack\n" \
+                  "\t\tstore these layers as CSR (0 keeps every non zero " \
+                  "weight)\n" \
+                  "\t--accuracy labels - compare every precision (and " \
+                  "--sparse) on the labeled images\n" \
+                  "\t\t(lines of \"image_path digit\") and exit\n" \
+                  "\t--threads n - worker threads of batch work " \
+                  "(default 0, one per cpu)\n" \
+                  "\t--affinity - pin every worker thread to its own cpu\n" \
+                  "\t--bulk images - classify every image of a manifest " \
+                  "(one path per line)\n" \
+                  "\t\tor of a directory, print \"path,digit,probability\" " \
+                  "lines and exit\n" \
+                  "\t--stream f32|u8 - classify the concatenated frames " \
+                  "(28x28 floats or bytes)\n" \
+                  "\t\tread from stdin, print a \"digit,probability\" " \
+                  "line per frame\n" \
+                  "\t--alloc-report image - print the heap allocations " \
+                  "of every layer\n" \
+                  "\t\tfor the first and a steady state inference of the " \
+                  "image and exit"
 
 
 #define ARGS_START_IDX 1
-#define ARGS_COUNT (ARGS_START_IDX + (MLP_SIZE * 2))
-#define WEIGHTS_START_IDX ARGS_START_IDX
-#define BIAS_START_IDX (ARGS_START_IDX + MLP_SIZE)
+#define PACK_FLAG "--pack"
+#define TOPOLOGY_FLAG "--topology"
+#define ACTIVATIONS_FLAG "--activations"
+#define PRECISION_FLAG "--precision"
+#define SPARSE_FLAG "--sparse"
+#define SPARSE_NAME "csr"
+#define ACCURACY_FLAG "--accuracy"
+#define THREADS_FLAG "--threads"
+#define AFFINITY_FLAG "--affinity"
+#define BULK_FLAG "--bulk"
+#define BULK_CHUNK_SIZE 4096
+#define BULK_BUFFER_SIZE (1 << 20)
+#define STREAM_FLAG "--stream"
+#define STREAM_F32_NAME "f32"
+#define STREAM_U8_NAME "u8"
+#define STREAM_BATCH_SIZE 1024
+#define U8_SCALE (1.0f / 255)
+#define ALLOC_REPORT_FLAG "--alloc-report"
+
+// names of WeightPrecision values, in the order of the enum
+const char *const precision_names[] = {"f32", "int8", "fp16", "bf16"};
+const int precision_count = sizeof(precision_names) / sizeof(char *);
+
+// names of ActivationType values, in the order of the enum
+const char *const activation_names[ACTIVATION_TYPE_COUNT] = {
+    "relu", "softmax", "sigmoid", "tanh", "gelu"};
+
+// compile time form of the default topology (see weights_dims)
+typedef StaticMlp<784, 128, 64, 20, 10> DefaultStaticMlp;
+
+/**
+ * @struct cli_options
+ * @brief Parsed program arguments.
+ */
+typedef struct cli_options {
+    std::string packPath;
+    std::string accuracyPath;
+    std::string bulkPath;
+    // frames format of --stream: "f32", "u8" or empty for no stream
+    std::string streamFormat;
+    std::string allocReportPath;
+    WeightPrecision precision = PRECISION_F32;
+    // negative for dense layers
+    float sparseThreshold = -1;
+    int threads = 0;
+    bool pin = false;
+    std::vector<int> topology;
+    std::vector<ActivationType> activations;
+    std::vector<std::string> paths;
+} cli_options;
+
+/**
+ * @struct mlp_model
+ * @brief Loaded network parameters, with the bundle or the mapped files
+ *        the (read only) views are over.
+ */
+typedef struct mlp_model {
+    ModelBundle bundle;
+    std::vector<MappedFile> files;
+    std::vector<MatrixView> weights, biases;
+    std::vector<ActivationType> activations;
+} mlp_model;
 
 
 
@@ -45,55 +176,372 @@ void usage()
  */
 bool readFileToMatrix(const std::string &filePath, Matrix &mat)
 {
-    std::ifstream is;
-    is.open(filePath, std::ios::in | std::ios::binary | std::ios::ate);
-    if(!is.is_open())
+    return read_image_file(filePath, mat.data(),
+                           (size_t) mat.get_cols() * mat.get_rows());
+}
+
+/**
+ * Given a binary file path, maps the file read-only into memory and makes
+ * a const view over the mapped floats (no copy, no read calls).
+ * file must match the given dims in order to map successfully.
+ * @param filePath - path of the binary file to map
+ * @param dims - expected dims of the matrix
+ * @param file - keeps the mapping alive, must outlive the view
+ * @param view - receives the view of the file
+ * @return boolean status
+ *          true - success
+ *          false - failure
+ */
+bool mapFileToView(const std::string &filePath, matrix_dims dims,
+    MappedFile &file, MatrixView &view)
+{
+    file = MappedFile(filePath);
+    size_t matByteSize = (size_t) dims.rows * dims.cols * sizeof(float);
+    if(!file.is_open() || file.size() != matByteSize)
     {
         return false;
     }
+    view = MatrixView((const float *) file.data(), dims.rows, dims.cols,
+                      dims.cols);
+    return true;
+}
+
+/**
+ * Loads MLP parameters from weights & biases paths
+ * to weights and biases. The files are mapped read-only and the
+ * parameters are const views over the mapped pages, so processes that load the
+ * same files share one physical copy of the parameters.
+ * Exits (code == 1) upon failures.
+ * @param paths weights paths of every layer, then biases paths of every
+ *        layer
+ * @param topology width of the input followed by the width of every layer
+ * @param model receives the parameters (and the mappings backing them)
+ */
+void loadParameters(const std::vector<std::string> &paths,
+    const std::vector<int> &topology, mlp_model &model)
+{
+    int layers = (int) topology.size() - 1;
+    model.files.resize(2 * layers);
+    model.weights.resize(layers);
+    model.biases.resize(layers);
+    for(int i = 0; i < layers; i++)
+    {
+        matrix_dims weightsDims = {topology[i + 1], topology[i]};
+        matrix_dims biasDims = {topology[i + 1], 1};
+
+        if(!(mapFileToView(paths[i], weightsDims, model.files[i],
+                           model.weights[i]) &&
+           mapFileToView(paths[layers + i], biasDims,
+                         model.files[layers + i], model.biases[i])))
+        {
+            std::cerr << ERROR_INAVLID_PARAMETER << (i + 1) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+    }
+}
+
+/**
+ * Loads the model bundle at path into model.
+ * Exits (code == 1) upon failures.
+ * @param path path of the bundle
+ * @param model receives the parameters (and the bundle backing them)
+ */
+void loadBundle(const std::string &path, mlp_model &model)
+{
+    if(!model.bundle.load(path))
+    {
+        std::cerr << ERROR_INVALID_BUNDLE << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(!model.bundle.has_float_weights())
+    {
+        // 16 bit weights, the network is built from model.bundle.layers()
+        return;
+    }
+    int layers = model.bundle.layer_count();
+    model.weights.assign(model.bundle.weights(),
+                         model.bundle.weights() + layers);
+    model.biases.assign(model.bundle.biases(),
+                        model.bundle.biases() + layers);
+    model.activations.assign(model.bundle.activations(),
+                             model.bundle.activations() + layers);
+}
+
+/**
+ * Builds the network of the loaded model.
+ * @param model loaded parameters
+ * @return the network
+ */
+MlpNetwork buildNetwork(const mlp_model &model)
+{
+    // the layers of a bundle read its mapped (packed) weights
+    if(model.bundle.layer_count() > 0)
+    {
+        return MlpNetwork(model.bundle.layers());
+    }
+    return MlpNetwork(model.weights.data(), model.biases.data(),
+                      model.activations.data(), (int) model.weights.size());
+}
 
-    long int matByteSize = (long int) mat.get_cols () * mat.get_rows ()  *
-        sizeof(float);
-    if(is.tellg() != matByteSize)
+/**
+ * Parses a comma separated list of positive integers.
+ * @param list the list, e.g. "784,64,10"
+ * @param values receives the integers
+ * @return true on success (at least an input and one layer)
+ */
+bool parseTopology(const std::string &list, std::vector<int> &values)
+{
+    std::stringstream ss(list);
+    std::string item;
+    values.clear();
+    while(std::getline(ss, item, ','))
+    {
+        char *end = nullptr;
+        long value = std::strtol(item.c_str(), &end, 10);
+        if(item.empty() || *end != '\0' || value <= 0 || value > INT32_MAX)
+        {
+            return false;
+        }
+        values.push_back((int) value);
+    }
+    return values.size() >= 2;
+}
+
+/**
+ * Parses a comma separated list of activation names (see
+ * activation_names).
+ * @param list the list, e.g. "relu,softmax"
+ * @param values receives the activations
+ * @return true on success
+ */
+bool parseActivations(const std::string &list,
+    std::vector<ActivationType> &values)
+{
+    std::stringstream ss(list);
+    std::string item;
+    values.clear();
+    while(std::getline(ss, item, ','))
+    {
+        int i = 0;
+        while(i < ACTIVATION_TYPE_COUNT && item != activation_names[i])
+        {
+            i++;
+        }
+        if(i == ACTIVATION_TYPE_COUNT)
+        {
+            return false;
+        }
+        values.push_back((ActivationType) i);
+    }
+    return !values.empty();
+}
+
+/**
+ * Parses a precision name (see precision_names).
+ * @param name the name, e.g. "int8"
+ * @param precision receives the precision
+ * @return true on success
+ */
+bool parsePrecision(const std::string &name, WeightPrecision &precision)
+{
+    for(int i = 0; i < precision_count; i++)
+    {
+        if(name == precision_names[i])
+        {
+            precision = (WeightPrecision) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Parses a non negative integer.
+ * @param text the integer, e.g. "8"
+ * @param value receives the integer
+ * @return true on success
+ */
+bool parseCount(const std::string &text, int &value)
+{
+    char *end = nullptr;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if(text.empty() || *end != '\0' || parsed < 0 || parsed > INT32_MAX)
     {
-        is.close();
         return false;
     }
+    value = (int) parsed;
+    return true;
+}
 
-    is.seekg(0, std::ios_base::beg);
-    read_binary_file (is, mat);
-    is.close();
+/**
+ * Parses a non negative float.
+ * @param text the float, e.g. "0.01"
+ * @param value receives the float
+ * @return true on success
+ */
+bool parseThreshold(const std::string &text, float &value)
+{
+    char *end = nullptr;
+    float parsed = std::strtof(text.c_str(), &end);
+    if(text.empty() || *end != '\0' || !(parsed >= 0) || std::isinf(parsed))
+    {
+        return false;
+    }
+    value = parsed;
     return true;
 }
 
 /**
- * Loads MLP parameters from weights & biases paths
- * to Weights[] and Biases[].
- * Exits (code == 1) upon failures.
- * @param paths array of programs arguments, expected to be mlp parameters
- *        path.
- * @param weights array of matrix, weigths[i] is the i'th layer weights matrix
- * @param biases array of matrix, biases[i] is the i'th layer bias matrix
- *          (which is actually a vector)
+ * Parses the program arguments, prints usage and exits (code == 1) when
+ * they are invalid.
+ * @param argc count of args
+ * @param argv args values
+ * @return the parsed options
  */
-void loadParameters(char *paths[ARGS_COUNT], Matrix weights[MLP_SIZE],
-    Matrix biases[MLP_SIZE])
+cli_options parseOptions(int argc, char **argv)
 {
-    for(int i = 0; i < MLP_SIZE; i++)
+    cli_options options;
+    for(int i = ARGS_START_IDX; i < argc; i++)
     {
-        weights[i] = Matrix(weights_dims[i].rows, weights_dims[i].cols);
-        biases[i] = Matrix(bias_dims[i].rows, bias_dims[i].cols);
+        std::string arg(argv[i]);
+        bool hasValue = i + 1 < argc;
+        bool valid = true;
+        if(arg == PACK_FLAG && hasValue)
+        {
+            options.packPath = argv[++i];
+        }
+        else if(arg == TOPOLOGY_FLAG && hasValue)
+        {
+            valid = parseTopology(argv[++i], options.topology);
+        }
+        else if(arg == ACTIVATIONS_FLAG && hasValue)
+        {
+            valid = parseActivations(argv[++i], options.activations);
+        }
+        else if(arg == PRECISION_FLAG && hasValue)
+        {
+            valid = parsePrecision(argv[++i], options.precision);
+        }
+        else if(arg == SPARSE_FLAG && hasValue)
+        {
+            valid = parseThreshold(argv[++i], options.sparseThreshold);
+        }
+        else if(arg == ACCURACY_FLAG && hasValue)
+        {
+            options.accuracyPath = argv[++i];
+        }
+        else if(arg == THREADS_FLAG && hasValue)
+        {
+            valid = parseCount(argv[++i], options.threads);
+        }
+        else if(arg == AFFINITY_FLAG)
+        {
+            options.pin = true;
+        }
+        else if(arg == BULK_FLAG && hasValue)
+        {
+            options.bulkPath = argv[++i];
+        }
+        else if(arg == ALLOC_REPORT_FLAG && hasValue)
+        {
+            options.allocReportPath = argv[++i];
+        }
+        else if(arg == STREAM_FLAG && hasValue)
+        {
+            options.streamFormat = argv[++i];
+            valid = options.streamFormat == STREAM_F32_NAME ||
+                    options.streamFormat == STREAM_U8_NAME;
+        }
+        else if(arg.compare(0, 2, "--") == 0)
+        {
+            valid = false;
+        }
+        else
+        {
+            options.paths.push_back(arg);
+        }
 
-        std::string weightsPath(paths[WEIGHTS_START_IDX + i]);
-        std::string biasPath(paths[BIAS_START_IDX + i]);
+        if(!valid)
+        {
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    return options;
+}
 
-        if(!(readFileToMatrix(weightsPath, weights[i]) &&
-           readFileToMatrix(biasPath, biases[i])))
+/**
+ * Loads the network parameters the options point to: a model bundle, or
+ * the raw weights & biases files of the given (or default) topology.
+ * Prints usage and exits (code == 1) when the arguments do not fit.
+ * @param options parsed program options
+ * @param model receives the parameters
+ */
+void loadModel(cli_options &options, mlp_model &model)
+{
+    bool bundle = options.packPath.empty() && options.paths.size() == 1;
+    if(bundle)
+    {
+        if(!options.topology.empty() || !options.activations.empty())
         {
-            std::cerr << ERROR_INAVLID_PARAMETER << (i + 1) << std::endl;
+            usage();
             exit(EXIT_FAILURE);
         }
+        loadBundle(options.paths[0], model);
+        return;
+    }
 
+    if(options.topology.empty())
+    {
+        options.topology.push_back(weights_dims[0].cols);
+        for(int i = 0; i < MLP_SIZE; i++)
+        {
+            options.topology.push_back(weights_dims[i].rows);
+        }
+    }
+    size_t layers = options.topology.size() - 1;
+    if(options.activations.empty())
+    {
+        options.activations.assign(layers, RELU);
+        options.activations.back() = SOFTMAX;
+    }
+    if(options.paths.size() != 2 * layers ||
+       options.activations.size() != layers)
+    {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    loadParameters(options.paths, options.topology, model);
+    model.activations = options.activations;
+}
+
+/**
+ * Converts the loaded parameters into a single model bundle.
+ * Exits (code == 1) upon failures.
+ * @param path path of the bundle to create
+ * @param model parameters to write
+ * @param precision f32, fp16 or bf16 weights
+ * @param sparseThreshold when not negative, layers sparse enough are
+ *        stored as CSR without the weights at most the threshold
+ */
+void packBundle(const std::string &path, const mlp_model &model,
+    WeightPrecision precision, float sparseThreshold)
+{
+    if(precision == PRECISION_INT8)
+    {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    BundleDtype dtype = precision == PRECISION_FP16 ? DTYPE_F16 :
+                        precision == PRECISION_BF16 ? DTYPE_BF16 : DTYPE_F32;
+    if(!ModelBundle::write(path, model.weights.data(), model.biases.data(),
+                           model.activations.data(),
+                           (int) model.weights.size(), dtype,
+                           sparseThreshold))
+    {
+        std::cerr << ERROR_WRITE_BUNDLE << path << std::endl;
+        exit(EXIT_FAILURE);
     }
 }
 
@@ -105,9 +553,10 @@ void loadParameters(char *paths[ARGS_COUNT], Matrix weights[MLP_SIZE],
  *                  print image & netowrk prediction
  *             }
  * Exits (code == 1) on fatal errors: unable to read user input path.
- * @param mlp MlpNetwork to use in order to predict img.
+ * @param mlp MlpNetwork (or StaticMlp) to use in order to predict img.
  */
-void mlpCli(MlpNetwork &mlp)
+template<class Network>
+void mlpCli(Network &mlp)
 {
     Matrix img(img_dims.rows, img_dims.cols);
     std::string imgPath;
@@ -124,8 +573,8 @@ void mlpCli(MlpNetwork &mlp)
     {
         if(readFileToMatrix(imgPath, img))
         {
-            Matrix imgVec = img;
-            digit output = mlp(imgVec.vectorize());
+            // the networks take the 28x28 matrix as is, no vectorized copy
+            digit output = mlp(img);
             std::cout << "Image processed:" << std::endl
                 << img << std::endl;
             std::cout << "Mlp result: " << output.value <<
@@ -146,6 +595,343 @@ void mlpCli(MlpNetwork &mlp)
     }
 }
 
+/**
+ * Classifies labeled images with every weights precision (and sparse
+ * weights when options has a sparse threshold) and prints the accuracy
+ * of each, with its agreement and largest probability difference against
+ * the float network.
+ * Exits (code == 1) if the labels file or one of its images is invalid.
+ * @param path file of lines "image_path digit"
+ * @param mlp network to evaluate, left in float precision
+ * @param options threads to classify with, sparse threshold
+ */
+void accuracyReport(const std::string &path, MlpNetwork &mlp,
+    const cli_options &options)
+{
+    std::ifstream is(path);
+    if(!is.is_open())
+    {
+        std::cerr << ERROR_INVALID_LABELS << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::vector<Matrix> imgs;
+    std::vector<unsigned int> labels;
+    std::string imgPath;
+    unsigned int label;
+    while(is >> imgPath >> label)
+    {
+        imgs.emplace_back(mlp.input_size(), 1);
+        if(!readFileToMatrix(imgPath, imgs.back()))
+        {
+            std::cerr << ERROR_INVALID_IMG << imgPath << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        labels.push_back(label);
+    }
+    if(!is.eof() || imgs.empty())
+    {
+        std::cerr << ERROR_INVALID_LABELS << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    int count = (int) imgs.size();
+    std::vector<digit> reference;
+    // the run after the precisions is the sparse one
+    int runs = precision_count + (options.sparseThreshold >= 0);
+    for(int p = 0; p < runs; p++)
+    {
+        if(p < precision_count)
+        {
+            mlp.set_precision((WeightPrecision) p);
+        }
+        else
+        {
+            mlp.set_precision(PRECISION_F32);
+            mlp.set_sparse(options.sparseThreshold);
+        }
+        BatchEngine engine(mlp, options.threads, options.pin);
+        std::vector<digit> results = engine.classify(imgs.data(), count);
+        if(p == PRECISION_F32)
+        {
+            reference = results;
+        }
+
+        int correct = 0, agree = 0;
+        float maxDiff = 0;
+        for(int i = 0; i < count; i++)
+        {
+            correct += results[i].value == labels[i];
+            agree += results[i].value == reference[i].value;
+            maxDiff = std::max(maxDiff, std::fabs(results[i].probability -
+                                                  reference[i].probability));
+        }
+        std::cout << (p < precision_count ? precision_names[p] : SPARSE_NAME)
+                  << ": accuracy "
+                  << (float) correct / count << " (" << correct << "/"
+                  << count << "), agreement with f32 "
+                  << (float) agree / count
+                  << ", max probability difference " << maxDiff
+                  << std::endl;
+    }
+    mlp.set_sparse(-1);
+    mlp.set_precision(PRECISION_F32);
+}
+
+/**
+ * Lists the images to classify in bulk: the regular files of a directory
+ * (sorted by name), or the non empty lines of a manifest file.
+ * @param path the directory or the manifest
+ * @param paths receives the images paths
+ * @return true on success
+ */
+bool listImages(const std::string &path, std::vector<std::string> &paths)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0)
+    {
+        return false;
+    }
+    if(!S_ISDIR(st.st_mode))
+    {
+        std::ifstream is(path);
+        std::string line;
+        while(std::getline(is, line))
+        {
+            if(!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if(!line.empty())
+            {
+                paths.push_back(line);
+            }
+        }
+        return is.eof();
+    }
+
+    DIR *dir = opendir(path.c_str());
+    if(dir == nullptr)
+    {
+        return false;
+    }
+    for(struct dirent *entry = readdir(dir); entry != nullptr;
+        entry = readdir(dir))
+    {
+        std::string filePath = path + "/" + entry->d_name;
+        if(stat(filePath.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        {
+            paths.push_back(filePath);
+        }
+    }
+    closedir(dir);
+    std::sort(paths.begin(), paths.end());
+    return true;
+}
+
+/**
+ * Classifies every image of a manifest or directory without rendering
+ * them. Chunks of images are prefetched on a background thread while the
+ * previous chunk is classified as a batch, and a "path,digit,probability"
+ * line per image is written to stdout through a large buffer. Invalid
+ * images are reported on stderr and skipped.
+ * Exits (code == 1) if the manifest or directory can not be read.
+ * @param path the manifest or directory
+ * @param mlp network to classify with
+ * @param options threads to classify with
+ */
+void bulkScore(const std::string &path, const MlpNetwork &mlp,
+    const cli_options &options)
+{
+    std::vector<std::string> paths;
+    if(!listImages(path, paths))
+    {
+        std::cerr << ERROR_INVALID_BULK << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(paths.empty())
+    {
+        return;
+    }
+
+    BatchEngine engine(mlp, options.threads, options.pin);
+    int imgSize = mlp.input_size();
+    ImagePrefetcher prefetcher(paths, imgSize, BULK_CHUNK_SIZE);
+    image_batch batch;
+    std::string out;
+    out.reserve(BULK_BUFFER_SIZE + FILENAME_MAX + 64);
+    char line[64];
+
+    while(prefetcher.next(batch))
+    {
+        Matrix chunk(batch.count, imgSize, batch.data);
+        std::vector<digit> digits = engine.classify(chunk);
+
+        for(int i = 0; i < batch.count; i++)
+        {
+            const std::string &imgPath = paths[batch.start + i];
+            if(!batch.loaded[i])
+            {
+                std::cerr << ERROR_INVALID_IMG << imgPath << std::endl;
+                continue;
+            }
+            snprintf(line, sizeof(line), ",%u,%g\n", digits[i].value,
+                     digits[i].probability);
+            out += imgPath;
+            out += line;
+            if(out.size() >= BULK_BUFFER_SIZE)
+            {
+                std::cout.write(out.data(), out.size());
+                out.clear();
+            }
+        }
+    }
+    std::cout.write(out.data(), out.size());
+    std::cout.flush();
+}
+
+/**
+ * Classifies a stream of concatenated frames read from stdin (a pipe, a
+ * FIFO or a file) and writes a "digit,probability" line per frame to
+ * stdout. Every read asks for a whole batch of frames straight into the
+ * batch buffer, and the complete frames received so far are classified
+ * and their results flushed right away, so frames are answered as they
+ * arrive. u8 frames are scaled by 1/255.
+ * Exits (code == 1) on read errors or if the stream ends inside a frame.
+ * @param format "f32" or "u8"
+ * @param mlp network to classify with
+ * @param options threads to classify with
+ */
+void streamScore(const std::string &format, const MlpNetwork &mlp,
+    const cli_options &options)
+{
+    BatchEngine engine(mlp, options.threads, options.pin);
+    int imgSize = mlp.input_size();
+    bool bytes = format == STREAM_U8_NAME;
+    size_t frameSize = bytes ? imgSize : imgSize * sizeof(float);
+    Matrix imgs(STREAM_BATCH_SIZE, imgSize);
+    // u8 frames are read aside and converted, f32 frames land in imgs
+    std::vector<unsigned char> raw(bytes ? frameSize * STREAM_BATCH_SIZE : 0);
+    unsigned char *buffer = bytes ? raw.data() : (unsigned char *) imgs.data();
+    size_t capacity = frameSize * STREAM_BATCH_SIZE;
+    size_t filled = 0;
+    std::vector<digit> digits(STREAM_BATCH_SIZE);
+    std::string out;
+    char line[64];
+
+    for(;;)
+    {
+        ssize_t n = read(STDIN_FILENO, buffer + filled, capacity - filled);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n < 0)
+        {
+            std::cerr << ERROR_STREAM_READ << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if(n == 0)
+        {
+            if(filled != 0)
+            {
+                std::cerr << ERROR_PARTIAL_FRAME << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            return;
+        }
+        filled += n;
+        int frames = (int) (filled / frameSize);
+        if(frames == 0)
+        {
+            continue;
+        }
+
+        if(bytes)
+        {
+            for(size_t i = 0; i < frames * frameSize; i++)
+            {
+                imgs[(int) i] = buffer[i] * U8_SCALE;
+            }
+        }
+        Matrix batch(frames, imgSize, imgs.data());
+        engine.classify(batch, digits.data());
+        out.clear();
+        for(int i = 0; i < frames; i++)
+        {
+            snprintf(line, sizeof(line), "%u,%g\n", digits[i].value,
+                     digits[i].probability);
+            out += line;
+        }
+        std::cout.write(out.data(), out.size());
+        std::cout.flush();
+
+        // keeps the start of the next frame at the front of the buffer
+        size_t used = frames * frameSize;
+        std::memmove(buffer, buffer + used, filled - used);
+        filled -= used;
+    }
+}
+
+/**
+ * Prints the heap activity of every layer for the first inference of an
+ * image (which sizes the buffers) and for a steady state inference.
+ * Exits (code == 1) if allocations are not counted in this build or the
+ * image is invalid.
+ * @param path path of the image
+ * @param mlp network to profile
+ */
+void allocReport(const std::string &path, MlpNetwork &mlp)
+{
+    if(!alloc_counting())
+    {
+        std::cerr << ERROR_NO_ALLOC_COUNTING << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    Matrix img(img_dims.rows, img_dims.cols);
+    if(!readFileToMatrix(path, img))
+    {
+        std::cerr << ERROR_INVALID_IMG << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    const char *const calls[] = {"first", "steady"};
+    std::vector<alloc_stats> layers(mlp.layer_count());
+    for(const char *call : calls)
+    {
+        mlp.profile_allocations(img, layers.data());
+        for(int i = 0; i < mlp.layer_count(); i++)
+        {
+            std::cout << call << " inference, layer " << (i + 1) << ": "
+                      << layers[i].allocs << " allocations ("
+                      << layers[i].bytes << " bytes), " << layers[i].frees
+                      << " frees" << std::endl;
+        }
+    }
+}
+
+/**
+ * Checks if the model is the default network (weights_dims with
+ * layers_activations), which has a compile time specialized form.
+ * @param model loaded parameters
+ * @return true for the default network
+ */
+bool isDefaultNetwork(const mlp_model &model)
+{
+    if(model.weights.size() != MLP_SIZE)
+    {
+        return false;
+    }
+    for(int i = 0; i < MLP_SIZE; i++)
+    {
+        if(model.weights[i].get_rows() != weights_dims[i].rows ||
+           model.weights[i].get_cols() != weights_dims[i].cols ||
+           model.activations[i] != layers_activations[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 /**
  * Program's main
  * @param argc count of args
@@ -154,17 +940,84 @@ void mlpCli(MlpNetwork &mlp)
  */
 int main(int argc, char **argv)
 {
-    if(argc != ARGS_COUNT)
+    cli_options options = parseOptions(argc, argv);
+    if(options.paths.empty())
     {
         usage();
         exit(EXIT_FAILURE);
     }
 
-    Matrix weights[MLP_SIZE];
-    Matrix biases[MLP_SIZE];
-    loadParameters(argv, weights, biases);
+    mlp_model model;
+    loadModel(options, model);
+    if(!options.packPath.empty())
+    {
+        packBundle(options.packPath, model, options.precision,
+                   options.sparseThreshold);
+        return EXIT_SUCCESS;
+    }
 
-    MlpNetwork mlp(weights, biases);
+    if(isDefaultNetwork(model) && options.precision == PRECISION_F32 &&
+       options.sparseThreshold < 0 && options.accuracyPath.empty() &&
+       options.bulkPath.empty() && options.streamFormat.empty() &&
+       options.allocReportPath.empty())
+    {
+        // compile time widths: stack activations, no allocation
+        DefaultStaticMlp mlp(model.weights.data(), model.biases.data());
+        mlpCli(mlp);
+        return EXIT_SUCCESS;
+    }
+
+    MlpNetwork mlp = buildNetwork(model);
+    if(mlp.input_size() != img_dims.rows * img_dims.cols)
+    {
+        std::cerr << ERROR_INVALID_NETWORK << img_dims.rows << "x"
+                  << img_dims.cols << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(!options.accuracyPath.empty())
+    {
+        if(model.weights.empty())
+        {
+            std::cerr << ERROR_FLOAT_WEIGHTS << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        accuracyReport(options.accuracyPath, mlp, options);
+        return EXIT_SUCCESS;
+    }
+    // a model with only 16 bit weights keeps them
+    if(!model.weights.empty() || options.precision != PRECISION_F32)
+    {
+        mlp.set_precision(options.precision);
+    }
+    if(options.sparseThreshold >= 0)
+    {
+        if(model.weights.empty())
+        {
+            std::cerr << ERROR_FLOAT_WEIGHTS << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if(options.precision != PRECISION_F32)
+        {
+            std::cerr << ERROR_SPARSE_PRECISION << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        mlp.set_sparse(options.sparseThreshold);
+    }
+    if(!options.allocReportPath.empty())
+    {
+        allocReport(options.allocReportPath, mlp);
+        return EXIT_SUCCESS;
+    }
+    if(!options.bulkPath.empty())
+    {
+        bulkScore(options.bulkPath, mlp, options);
+        return EXIT_SUCCESS;
+    }
+    if(!options.streamFormat.empty())
+    {
+        streamScore(options.streamFormat, mlp, options);
+        return EXIT_SUCCESS;
+    }
     mlpCli(mlp);
     return EXIT_SUCCESS;
 }
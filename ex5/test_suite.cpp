@@ -0,0 +1,855 @@
+// the checks are asserts, keep them in release builds
+#undef NDEBUG
+
+#include "test_suite.h"
+#include "StaticMlp.h"
+#include "ModelBundle.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#define TEST_BATCH_SIZE 64
+#define PRECISION_COUNT 4
+#define TEST_BUNDLE_PATH "test_suite_bundle.mlpb"
+
+/**
+ * fills a matrix with deterministic values in [-scale, scale)
+ * @param m matrix to fill
+ * @param seed seed of the values
+ * @param scale largest absolute value
+ */
+static void fill (Matrix &m, uint32_t seed, float scale) {
+  for (int i = 0; i < m.get_rows () * m.get_cols (); ++i) {
+    seed = seed * 1664525u + 1013904223u;
+    m[i] = ((float) (seed >> 8) / (1 << 24) * 2 - 1) * scale;
+  }
+}
+
+/**
+ * parameters of the default topology
+ */
+struct test_model {
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+
+  test_model () {
+    for (int i = 0; i < MLP_SIZE; ++i) {
+      weights[i] = Matrix (weights_dims[i].rows, weights_dims[i].cols);
+      biases[i] = Matrix (bias_dims[i].rows, bias_dims[i].cols);
+      fill (weights[i], 17 + i, 1.0f / std::sqrt (weights_dims[i].cols));
+      fill (biases[i], 91 + i, 0.1f);
+    }
+  }
+};
+
+/**
+ * writes the layers of a test model to TEST_BUNDLE_PATH
+ * @param model model to write
+ * @param dtype element type to store the weights in
+ * @param sparse_threshold see ModelBundle::write
+ * @return true on success
+ */
+static bool write_test_bundle (const test_model &model,
+                               BundleDtype dtype = DTYPE_F32,
+                               float sparse_threshold = -1) {
+  std::vector<MatrixView> weights (model.weights, model.weights + MLP_SIZE);
+  std::vector<MatrixView> biases (model.biases, model.biases + MLP_SIZE);
+  return ModelBundle::write (TEST_BUNDLE_PATH, weights.data (),
+                             biases.data (), layers_activations, MLP_SIZE,
+                             dtype, sparse_threshold);
+}
+
+/**
+ * This function checks that the allocation counter sees operator new and
+ * operator delete.
+ */
+void test_alloc_counter () {
+  assert(alloc_counting ());
+  alloc_stats before = alloc_count ();
+  // a call of the function, new expressions may be optimized out
+  void *p = ::operator new (10 * sizeof (int));
+  alloc_stats allocated = alloc_diff (alloc_count (), before);
+  assert(allocated.allocs == 1);
+  assert(allocated.frees == 0);
+  assert(allocated.bytes >= 10 * sizeof (int));
+  ::operator delete (p);
+  alloc_stats freed = alloc_diff (alloc_count (), before);
+  assert(freed.allocs == 1);
+  assert(freed.frees == 1);
+}
+
+/**
+ * This function checks that a steady state MlpNetwork::operator () call
+ * does no heap allocation in any layer, for every weights precision.
+ */
+void test_single_inference_no_alloc () {
+  test_model model;
+  Matrix img (img_dims.rows, img_dims.cols);
+  fill (img, 5, 1);
+  for (int p = 0; p < PRECISION_COUNT; ++p) {
+    MlpNetwork mlp (model.weights, model.biases);
+    mlp.set_precision ((WeightPrecision) p);
+    // warm up: sizes the per thread buffers of the products
+    mlp (img);
+
+    alloc_stats layers[MLP_SIZE];
+    mlp.profile_allocations (img, layers);
+    for (int i = 0; i < MLP_SIZE; ++i) {
+      assert(layers[i].allocs == 0);
+      assert(layers[i].frees == 0);
+    }
+    alloc_stats before = alloc_count ();
+    mlp (img);
+    alloc_stats call = alloc_diff (alloc_count (), before);
+    assert(call.allocs == 0);
+    assert(call.frees == 0);
+  }
+}
+
+/**
+ * This function checks that a steady state MlpNetwork::classify_batch call
+ * does no heap allocation, for every weights precision.
+ */
+void test_batch_inference_no_alloc () {
+  test_model model;
+  Matrix imgs (TEST_BATCH_SIZE, img_dims.rows * img_dims.cols);
+  fill (imgs, 7, 1);
+  digit digits[TEST_BATCH_SIZE];
+  for (int p = 0; p < PRECISION_COUNT; ++p) {
+    MlpNetwork mlp (model.weights, model.biases);
+    mlp.set_precision ((WeightPrecision) p);
+    mlp.classify_batch (imgs, digits);
+
+    alloc_stats before = alloc_count ();
+    for (int n = TEST_BATCH_SIZE; n > 0; n /= 2) {
+      // views of the first n rows allocate nothing either
+      Matrix batch (n, imgs.get_cols (), imgs.data ());
+      mlp.classify_batch (batch, digits);
+    }
+    alloc_stats calls = alloc_diff (alloc_count (), before);
+    assert(calls.allocs == 0);
+    assert(calls.frees == 0);
+  }
+}
+
+/**
+ * This function checks that a batch gives the digits of single
+ * inferences of its images.
+ */
+void test_batch_matches_single () {
+  test_model model;
+  Matrix imgs (TEST_BATCH_SIZE, img_dims.rows * img_dims.cols);
+  fill (imgs, 11, 1);
+  MlpNetwork mlp (model.weights, model.biases);
+  digit digits[TEST_BATCH_SIZE];
+  mlp.classify_batch (imgs, digits);
+  for (int n = 0; n < TEST_BATCH_SIZE; ++n) {
+    Matrix img (imgs.get_cols (), 1,
+                imgs.data () + (size_t) n * imgs.get_cols ());
+    digit single = mlp (img);
+    assert(single.value == digits[n].value);
+    assert(std::fabs (single.probability - digits[n].probability) < 1e-5f);
+  }
+}
+
+/**
+ * This function checks that the compile time network gives the digits
+ * and probabilities of MlpNetwork, with the same softmax.
+ */
+void test_static_matches_network () {
+  test_model model;
+  Matrix imgs (TEST_BATCH_SIZE, img_dims.rows * img_dims.cols);
+  fill (imgs, 13, 1);
+  MlpNetwork mlp (model.weights, model.biases);
+  StaticMlp<784, 128, 64, 20, 10> static_mlp (model.weights, model.biases);
+  for (int n = 0; n < TEST_BATCH_SIZE; ++n) {
+    Matrix img (imgs.get_cols (), 1,
+                imgs.data () + (size_t) n * imgs.get_cols ());
+    digit expected = mlp (img), result = static_mlp (img.data ());
+    assert(result.value == expected.value);
+    assert(std::fabs (result.probability - expected.probability) < 1e-5f);
+  }
+}
+
+/**
+ * This function checks that the float layers of a bundle read the packed
+ * panels stored in it instead of packing their weights on the heap, and
+ * give the digits and probabilities of the loose weights.
+ */
+void test_bundle_packed_panels () {
+  test_model model;
+  assert(write_test_bundle (model));
+  {
+    ModelBundle bundle;
+    assert(bundle.load (TEST_BUNDLE_PATH));
+    size_t weights_bytes = 0;
+    for (int i = 0; i < MLP_SIZE; ++i) {
+      weights_bytes += (size_t) weights_dims[i].rows * weights_dims[i].cols
+                       * sizeof (float);
+    }
+    alloc_stats before = alloc_count ();
+    std::vector<Dense> layers = bundle.layers ();
+    alloc_stats built = alloc_diff (alloc_count (), before);
+    // packing would allocate at least one copy of the weights
+    assert(built.bytes < weights_bytes / 4);
+
+    MlpNetwork mapped (std::move (layers));
+    MlpNetwork mlp (model.weights, model.biases);
+    Matrix imgs (TEST_BATCH_SIZE, img_dims.rows * img_dims.cols);
+    fill (imgs, 29, 1);
+    for (int n = 0; n < TEST_BATCH_SIZE; ++n) {
+      Matrix img (imgs.get_cols (), 1,
+                  imgs.data () + (size_t) n * imgs.get_cols ());
+      digit expected = mlp (img), result = mapped (img);
+      assert(result.value == expected.value);
+      assert(std::fabs (result.probability - expected.probability) < 1e-5f);
+    }
+  }
+  std::remove (TEST_BUNDLE_PATH);
+}
+
+/**
+ * reads a whole file
+ * @param path path of the file
+ * @return the bytes of the file
+ */
+static std::vector<char> read_bytes (const std::string &path) {
+  std::ifstream is (path, std::ios::in | std::ios::binary);
+  return std::vector<char> (std::istreambuf_iterator<char> (is),
+                            std::istreambuf_iterator<char> ());
+}
+
+/**
+ * writes the first size bytes of a buffer to TEST_BUNDLE_PATH
+ * @param bytes bytes to write
+ * @param size number of bytes to write
+ */
+static void write_bytes (const std::vector<char> &bytes, size_t size) {
+  std::ofstream os (TEST_BUNDLE_PATH, std::ios::out | std::ios::binary
+                                      | std::ios::trunc);
+  os.write (bytes.data (), size);
+}
+
+/**
+ * @param bytes bytes of a bundle
+ * @param i index of a layer
+ * @return the record of the layer
+ */
+static bundle_layer read_record (const std::vector<char> &bytes, int i) {
+  bundle_layer layer;
+  std::memcpy (&layer, bytes.data () + sizeof (bundle_header)
+                       + i * sizeof (bundle_layer), sizeof (layer));
+  return layer;
+}
+
+/**
+ * replaces the record of a layer in the bytes of a bundle
+ * @param bytes bytes of a bundle
+ * @param i index of the layer
+ * @param layer the new record
+ */
+static void write_record (std::vector<char> &bytes, int i,
+                          const bundle_layer &layer) {
+  std::memcpy (bytes.data () + sizeof (bundle_header)
+               + i * sizeof (bundle_layer), &layer, sizeof (layer));
+}
+
+/**
+ * This function checks that a written bundle loads back the same layers:
+ * float weights and biases element by element, 16 bit and sparse weights
+ * through the outputs of the matching network.
+ */
+void test_bundle_round_trip () {
+  test_model model;
+  Matrix imgs (TEST_BATCH_SIZE, img_dims.rows * img_dims.cols);
+  fill (imgs, 31, 1);
+  {
+    assert(write_test_bundle (model));
+    ModelBundle bundle;
+    assert(bundle.load (TEST_BUNDLE_PATH));
+    assert(bundle.layer_count () == MLP_SIZE && bundle.has_float_weights ());
+    for (int i = 0; i < MLP_SIZE; ++i) {
+      assert(bundle.activations ()[i] == layers_activations[i]);
+      const MatrixView &w = bundle.weights ()[i], &b = bundle.biases ()[i];
+      assert(w.get_rows () == weights_dims[i].rows
+             && w.get_cols () == weights_dims[i].cols);
+      for (int r = 0; r < w.get_rows (); ++r) {
+        assert(b (r, 0) == model.biases[i][r]);
+        for (int c = 0; c < w.get_cols (); ++c) {
+          assert(w (r, c) == model.weights[i] (r, c));
+        }
+      }
+    }
+  }
+  {
+    assert(write_test_bundle (model, DTYPE_F16));
+    ModelBundle bundle;
+    assert(bundle.load (TEST_BUNDLE_PATH));
+    assert(!bundle.has_float_weights ());
+    MlpNetwork mapped (bundle.layers ());
+    MlpNetwork mlp (model.weights, model.biases);
+    mlp.set_precision (PRECISION_FP16);
+    for (int n = 0; n < TEST_BATCH_SIZE; ++n) {
+      Matrix img (imgs.get_cols (), 1,
+                  imgs.data () + (size_t) n * imgs.get_cols ());
+      digit expected = mlp (img), result = mapped (img);
+      assert(result.value == expected.value);
+      assert(std::fabs (result.probability - expected.probability) < 1e-5f);
+    }
+  }
+  {
+    // prune about 60% of the weights, every layer is then stored sparse
+    for (int i = 0; i < MLP_SIZE; ++i) {
+      float scale = 1.0f / std::sqrt (weights_dims[i].cols);
+      for (int k = 0; k < weights_dims[i].rows * weights_dims[i].cols; ++k) {
+        if (std::fabs (model.weights[i][k]) < 0.6f * scale) {
+          model.weights[i][k] = 0;
+        }
+      }
+    }
+    assert(write_test_bundle (model, DTYPE_F32, 0));
+    ModelBundle bundle;
+    assert(bundle.load (TEST_BUNDLE_PATH));
+    assert(!bundle.has_float_weights ());
+    MlpNetwork mapped (bundle.layers ());
+    MlpNetwork mlp (model.weights, model.biases);
+    for (int n = 0; n < TEST_BATCH_SIZE; ++n) {
+      Matrix img (imgs.get_cols (), 1,
+                  imgs.data () + (size_t) n * imgs.get_cols ());
+      digit expected = mlp (img), result = mapped (img);
+      assert(result.value == expected.value);
+      assert(std::fabs (result.probability - expected.probability) < 1e-4f);
+    }
+  }
+  std::remove (TEST_BUNDLE_PATH);
+}
+
+/**
+ * This function checks that a bundle cut anywhere (in the header, in the
+ * layer records or in the last tensor) is rejected.
+ */
+void test_bundle_rejects_truncated () {
+  test_model model;
+  assert(write_test_bundle (model));
+  std::vector<char> bytes = read_bytes (TEST_BUNDLE_PATH);
+  const size_t sizes[] = {0, sizeof (bundle_header) - 1,
+                          sizeof (bundle_header) + sizeof (bundle_layer),
+                          bytes.size () / 2, bytes.size () - 1};
+  ModelBundle bundle;
+  for (size_t size : sizes) {
+    write_bytes (bytes, size);
+    assert(!bundle.load (TEST_BUNDLE_PATH));
+    assert(bundle.layer_count () == 0);
+  }
+  write_bytes (bytes, bytes.size ());
+  assert(bundle.load (TEST_BUNDLE_PATH));
+  std::remove (TEST_BUNDLE_PATH);
+}
+
+/**
+ * This function checks that a bundle whose records point a tensor past
+ * the end of the file, or at an unaligned offset, is rejected.
+ */
+void test_bundle_rejects_bad_offsets () {
+  test_model model;
+  assert(write_test_bundle (model));
+  const std::vector<char> bytes = read_bytes (TEST_BUNDLE_PATH);
+  const uint64_t past_end = (bytes.size () / BUNDLE_ALIGNMENT + 1)
+                            * BUNDLE_ALIGNMENT;
+  ModelBundle bundle;
+  for (int i = 0; i < MLP_SIZE; ++i) {
+    for (int field = 0; field < 4; ++field) {
+      std::vector<char> corrupted (bytes);
+      bundle_layer layer = read_record (corrupted, i);
+      if (field == 0) {
+        layer.weights_offset = past_end;
+      }
+      else if (field == 1) {
+        layer.bias_offset = past_end;
+      }
+      else if (field == 2) {
+        layer.packed_offset = past_end;
+      }
+      else {
+        // in the file, but not aligned
+        layer.weights_offset += sizeof (float);
+      }
+      write_record (corrupted, i, layer);
+      write_bytes (corrupted, corrupted.size ());
+      assert(!bundle.load (TEST_BUNDLE_PATH));
+    }
+  }
+  std::remove (TEST_BUNDLE_PATH);
+}
+
+/**
+ * This function checks that a bundle with sparse weights whose column
+ * indices fall outside the layer is rejected.
+ */
+void test_bundle_rejects_bad_columns () {
+  Matrix w (20, 30), bias (20, 1);
+  fill (w, 33, 1);
+  fill (bias, 34, 0.1f);
+  MatrixView weights[] = {w}, biases[] = {bias};
+  const ActivationType activations[] = {SOFTMAX};
+  assert(ModelBundle::write (TEST_BUNDLE_PATH, weights, biases, activations,
+                             1, DTYPE_F32, 0.8f));
+  const std::vector<char> bytes = read_bytes (TEST_BUNDLE_PATH);
+  bundle_layer layer = read_record (bytes, 0);
+  assert(layer.dtype == DTYPE_CSR);
+  ModelBundle bundle;
+  assert(bundle.load (TEST_BUNDLE_PATH));
+  // the columns follow the rows + 1 row offsets
+  size_t columns = layer.weights_offset + (layer.rows + 1) * sizeof (int32_t);
+  const int32_t bad_columns[] = {-1, (int32_t) layer.cols, INT32_MAX};
+  for (int32_t column : bad_columns) {
+    std::vector<char> corrupted (bytes);
+    std::memcpy (corrupted.data () + columns, &column, sizeof (column));
+    write_bytes (corrupted, corrupted.size ());
+    assert(!bundle.load (TEST_BUNDLE_PATH));
+  }
+  std::remove (TEST_BUNDLE_PATH);
+}
+
+/**
+ * This function checks that element-wise Matrix expressions give the
+ * element by element results and allocate only the result, and that
+ * assigning one to a view writes into the viewed elements.
+ */
+void test_matrix_expressions () {
+  // odd sizes leave a tail after the packets of the evaluation loop
+  Matrix a (7, 3), b (7, 3), c (7, 3);
+  fill (a, 3, 1);
+  fill (b, 4, 1);
+  fill (c, 5, 1);
+
+  alloc_stats before = alloc_count ();
+  Matrix result = 2.5f * (a + b).dot (c);
+  alloc_stats fused = alloc_diff (alloc_count (), before);
+  assert(fused.allocs == 1);
+  for (int i = 0; i < 21; ++i) {
+    assert(result[i] == 2.5f * ((a[i] + b[i]) * c[i]));
+  }
+
+  // the result is an operand of its own expression
+  Matrix sum (a);
+  before = alloc_count ();
+  sum = sum + b.dot (c) * 2;
+  sum += a;
+  alloc_stats in_place = alloc_diff (alloc_count (), before);
+  assert(in_place.allocs == 0);
+  for (int i = 0; i < 21; ++i) {
+    assert(sum[i] == (a[i] + b[i] * c[i] * 2) + a[i]);
+  }
+
+  // a view is written through, its elements keep their storage
+  Matrix view (a.get_rows (), a.get_cols (), sum.data ());
+  view = view + a;
+  assert(view.data () == sum.data () && !view.owns_data ());
+  for (int i = 0; i < 21; ++i) {
+    assert(sum[i] == (a[i] + b[i] * c[i] * 2) + a[i] + a[i]);
+  }
+
+  // the reading members of a matrix work on expressions
+  assert((a + b).get_rows () == 7 && (a + b) (6, 2) == a (6, 2) + b (6, 2));
+  assert((a + b).transpose () (2, 6) == a (6, 2) + b (6, 2));
+}
+
+/**
+ * This function checks that sparse products match the dense products of
+ * the same pruned weights, for a vector and for batches.
+ */
+void test_sparse_matches_dense () {
+  Matrix w (37, 53), bias (37, 1);
+  fill (w, 7, 1);
+  fill (bias, 8, 0.1f);
+  // prune about 80% of the weights
+  for (int i = 0; i < w.get_rows () * w.get_cols (); ++i) {
+    if (std::fabs (w[i]) < 0.8f) {
+      w[i] = 0;
+    }
+  }
+  SparseMatrix sparse (w);
+  assert(sparse.density () < 0.3f);
+  gemm_epilogue epilogue = {bias.data (), true};
+  // every tail of the vectorized loops
+  for (int n : {1, 7, 8, 45}) {
+    Matrix in (w.get_cols (), n), dense (w.get_rows (), n),
+        result (w.get_rows (), n);
+    fill (in, 9 + n, 1);
+    gemm (w.get_rows (), n, w.get_cols (), w.data (), w.get_cols (),
+          in.data (), n, dense.data (), n, epilogue);
+    sparse.multiply (in.data (), n, result.data (), epilogue);
+    for (int i = 0; i < w.get_rows () * n; ++i) {
+      assert(std::fabs (result[i] - dense[i]) < 1e-4f);
+    }
+  }
+}
+
+/**
+ * This function checks that single inputs mostly made of zeros give the
+ * outputs of the dense product when they skip their zeros.
+ */
+void test_sparse_input_matches_dense () {
+  // not a multiple of the rows the kernel holds in registers
+  Matrix w (83, 61), bias (83, 1), in (61, 1);
+  fill (w, 12, 1);
+  fill (bias, 13, 0.1f);
+  fill (in, 14, 1);
+  // keep about a quarter of the inputs
+  for (int c = 0; c < in.get_rows (); ++c) {
+    if (in[c] < 0.5f) {
+      in[c] = 0;
+    }
+  }
+  Dense dense (w, bias, RELU), sparse (w, bias, RELU);
+  assert(sparse.set_sparse_input (true));
+  Matrix expected = dense (in), result = sparse (in);
+  for (int r = 0; r < w.get_rows (); ++r) {
+    assert(std::fabs (result[r] - expected[r]) < 1e-4f);
+  }
+}
+
+/**
+ * This function checks that the int8 products of batches, multiplied
+ * QUANTIZE_BLOCK inputs per pass, give the products of single inputs.
+ */
+void test_quantized_batch_matches_single () {
+  // cols that are not a multiple of QUANTIZE_ALIGN leave padding
+  Matrix w (29, 53), bias (29, 1), wide (5, 100);
+  fill (w, 35, 1);
+  fill (bias, 36, 0.1f);
+  fill (wide, 37, 1);
+  QuantizedMatrix q (w), q_wide (wide);
+  gemm_epilogue epilogue = {bias.data (), true};
+  // full blocks and every tail
+  for (int n : {1, 3, QUANTIZE_BLOCK, 9}) {
+    Matrix in (w.get_cols (), n), result (w.get_rows (), n);
+    Matrix wide_in (wide.get_cols (), n), wide_out (wide.get_rows (), n);
+    fill (in, 38 + n, 1);
+    fill (wide_in, 39 + n, 1);
+    // leaves longer inputs in the per thread buffer
+    q_wide.multiply (wide_in.data (), n, wide_out.data (), epilogue);
+    q.multiply (in.data (), n, result.data (), epilogue);
+    for (int j = 0; j < n; ++j) {
+      Matrix single_in (w.get_cols (), 1), single (w.get_rows (), 1);
+      for (int k = 0; k < w.get_cols (); ++k) {
+        single_in[k] = in (k, j);
+      }
+      q.multiply (single_in.data (), 1, single.data (), epilogue);
+      for (int r = 0; r < w.get_rows (); ++r) {
+        assert(result (r, j) == single[r]);
+      }
+    }
+  }
+}
+
+/**
+ * This function checks that the matrix-vector kernels give the products
+ * of the blocked gemm, for 1 to GEMV_MAX_VECTORS vectors.
+ */
+void test_gemv_matches_gemm () {
+  // odd sizes leave a tail after the vectorized loops and the row groups,
+  // more than GEMV_KC cols split the copies of several vectors
+  Matrix a (37, GEMV_KC + 89), bias (37, 1);
+  fill (a, 15, 1);
+  fill (bias, 16, 0.1f);
+  gemm_epilogue epilogue = {bias.data (), true};
+  for (int n = 1; n <= GEMV_MAX_VECTORS; ++n) {
+    Matrix b (a.get_cols (), n), expected (a.get_rows (), n),
+        result (a.get_rows (), n);
+    fill (b, 17 + n, 1);
+    gemm (a.get_rows (), n, a.get_cols (), a.data (), a.get_cols (),
+          b.data (), n, expected.data (), n, epilogue);
+    gemv (a.get_rows (), n, a.get_cols (), a.data (), a.get_cols (),
+          b.data (), n, result.data (), n, epilogue);
+    for (int i = 0; i < a.get_rows () * n; ++i) {
+      assert(std::fabs (result[i] - expected[i]) < 1e-4f);
+    }
+  }
+}
+
+/**
+ * product of a naive triple loop, accumulated in double
+ * @param a left operand
+ * @param b right operand
+ * @param bias bias of every row of the product, or nullptr
+ * @param relu true to apply relu to the product
+ * @return a * b, plus bias and relu
+ */
+static Matrix reference_product (const Matrix &a, const Matrix &b,
+                                 const float *bias, bool relu) {
+  Matrix c (a.get_rows (), b.get_cols ());
+  for (int i = 0; i < a.get_rows (); ++i) {
+    for (int j = 0; j < b.get_cols (); ++j) {
+      double sum = bias != nullptr ? bias[i] : 0;
+      for (int p = 0; p < a.get_cols (); ++p) {
+        sum += (double) a (i, p) * b (p, j);
+      }
+      c (i, j) = relu && sum < 0 ? 0 : (float) sum;
+    }
+  }
+  return c;
+}
+
+/**
+ * This function checks that gemm, gemv and Matrix::operator* give the
+ * products of a naive triple loop, for sizes that leave tails in every
+ * tile (GEMM_MR, GEMM_NR, GEMM_KC and GEMM_MC) and for single rows and
+ * single columns.
+ */
+void test_gemm_matches_reference () {
+  // {m, n, k}
+  const int shapes[][3] = {{133, 13, 301}, {133, 200, 301}, {1, 200, 301},
+                           {133, 1, 301}, {1, 1, 301}, {200, 7, 1},
+                           {1, 13, 5}, {29, 1, 1}};
+  for (const int *shape : shapes) {
+    int m = shape[0], n = shape[1], k = shape[2];
+    Matrix a (m, k), b (k, n), bias (m, 1), result (m, n);
+    fill (a, 41 + m, 1);
+    fill (b, 42 + n, 1);
+    fill (bias, 43, 0.1f);
+    // the rounding of the float sums grows with k
+    float tolerance = 1e-5f * (k + 1);
+    gemm_epilogue epilogue = {bias.data (), true};
+    Matrix expected = reference_product (a, b, bias.data (), true);
+    gemm (m, n, k, a.data (), k, b.data (), n, result.data (), n, epilogue);
+    for (int i = 0; i < m * n; ++i) {
+      assert(std::fabs (result[i] - expected[i]) < tolerance);
+    }
+    if (n <= GEMV_MAX_VECTORS) {
+      gemv (m, n, k, a.data (), k, b.data (), n, result.data (), n,
+            epilogue);
+      for (int i = 0; i < m * n; ++i) {
+        assert(std::fabs (result[i] - expected[i]) < tolerance);
+      }
+    }
+    expected = reference_product (a, b, nullptr, false);
+    result = a * b;
+    assert(result.get_rows () == m && result.get_cols () == n);
+    for (int i = 0; i < m * n; ++i) {
+      assert(std::fabs (result[i] - expected[i]) < tolerance);
+    }
+  }
+}
+
+/**
+ * This function checks that a matrix with padded rows has aligned rows and
+ * gives the elements, expressions, products, activations, vectors and
+ * file reads of the same matrix without padding.
+ */
+void test_padded_matrix () {
+  // 21 cols pad to 32
+  Matrix dense (9, 21), padded (9, 21, Matrix::padded_ld (21));
+  assert(padded.get_ld () == 32 && !padded.is_contiguous ());
+  fill (dense, 19, 1);
+  for (int i = 0; i < dense.get_rows () * dense.get_cols (); ++i) {
+    padded[i] = dense[i];
+  }
+  for (int r = 0; r < padded.get_rows (); ++r) {
+    assert((uintptr_t) (padded.data () + r * padded.get_ld ())
+           % MATRIX_ALIGNMENT == 0);
+    for (int c = 0; c < padded.get_cols (); ++c) {
+      assert(padded (r, c) == dense (r, c));
+    }
+  }
+
+  Matrix copy (padded);
+  assert(copy.get_ld () == padded.get_ld ());
+  // the copy of a view zeroes the padding, whatever the viewed one holds
+  float strided[2 * 32];
+  for (int i = 0; i < 2 * 32; ++i) {
+    strided[i] = 1.0f + i;
+  }
+  const Matrix strided_view (2, 21, strided, 32);
+  Matrix strided_copy (strided_view);
+  assert(strided_copy.owns_data () && strided_copy.get_ld () == 32);
+  for (int r = 0; r < 2; ++r) {
+    for (int c = 0; c < 32; ++c) {
+      assert(strided_copy.data ()[r * 32 + c]
+             == (c < 21 ? strided[r * 32 + c] : 0));
+    }
+  }
+  copy = copy + padded.dot (dense) * 2;
+  Matrix expected = dense + dense.dot (dense) * 2;
+  Matrix v (dense.get_cols (), 3);
+  fill (v, 20, 1);
+  Matrix product = padded * v, dense_product = dense * v;
+  for (int i = 0; i < dense.get_rows () * dense.get_cols (); ++i) {
+    assert(copy[i] == expected[i]);
+  }
+  for (int i = 0; i < product.get_rows () * product.get_cols (); ++i) {
+    assert(product[i] == dense_product[i]);
+  }
+  // activations skip the padding, which stays zero
+  for (int type = 0; type < ACTIVATION_TYPE_COUNT; ++type) {
+    Activation activation ((ActivationType) type);
+    Matrix padded_out = activation (padded), dense_out = activation (dense);
+    for (int r = 0; r < padded.get_rows (); ++r) {
+      for (int c = 0; c < padded.get_ld (); ++c) {
+        float value = padded_out.data ()[r * padded.get_ld () + c];
+        // the vector kernels and their scalar tails round differently
+        assert(c < padded.get_cols ()
+               ? std::fabs (value - dense_out (r, c)) < 1e-5f : value == 0);
+      }
+    }
+  }
+
+  std::stringstream file;
+  file.write ((const char *) dense.data (),
+              dense.get_rows () * dense.get_cols () * sizeof (float));
+  Matrix read (9, 21, Matrix::padded_ld (21));
+  read_binary_file (file, read);
+  read.vectorize ();
+  assert(read.get_rows () == 9 * 21 && read.is_contiguous ());
+  for (int i = 0; i < read.get_rows (); ++i) {
+    assert(read.data ()[i] == dense[i]);
+  }
+}
+
+/**
+ * This function checks that views (blocks, rows, cols and transposes)
+ * read the elements of their matrix without copying them, and that the
+ * products and expressions of views match those of copied matrices, also
+ * when an expression reads its destination transposed or shifted.
+ */
+void test_matrix_views () {
+  // 70 x 45 crosses the gemm tiles and the transposed copy tiles
+  Matrix a (70, 45), b (70, 13);
+  fill (a, 21, 1);
+  fill (b, 22, 1);
+
+  alloc_stats before = alloc_count ();
+  MatrixView at = MatrixView (a).transpose ();
+  MatrixView block = at.block (3, 5, 20, 30);
+  MatrixView row = block.row (7), col = block.col (11);
+  alloc_stats views = alloc_diff (alloc_count (), before);
+  assert(views.allocs == 0);
+  assert(block (2, 4) == a (9, 5));
+  assert(row (0, 2) == a (7, 10) && col (4, 0) == a (16, 7));
+
+  Matrix a_t (a);
+  a_t.transpose ();
+  for (int r = 0; r < a_t.get_rows (); ++r) {
+    for (int c = 0; c < a_t.get_cols (); ++c) {
+      assert(a_t (r, c) == a (c, r));
+    }
+  }
+
+  // A^T * B for every product kernel: wide, a few vectors and one vector
+  const int widths[] = {13, 3, 1};
+  for (int n : widths) {
+    MatrixView b_n = MatrixView (b).block (0, 0, b.get_rows (), n);
+    Matrix product = at * b_n, expected = a_t * Matrix (b_n);
+    for (int i = 0; i < expected.get_rows () * n; ++i) {
+      assert(std::fabs (product[i] - expected[i]) < 1e-4f);
+    }
+  }
+  // a transposed right operand
+  Matrix product = a * at, expected = a * a_t;
+  for (int i = 0; i < expected.get_rows () * expected.get_cols (); ++i) {
+    assert(std::fabs (product[i] - expected[i]) < 1e-4f);
+  }
+
+  Matrix sum = a_t + at.dot (a_t) * 2;
+  for (int i = 0; i < sum.get_rows () * sum.get_cols (); ++i) {
+    assert(sum[i] == a_t[i] + a_t[i] * a_t[i] * 2);
+  }
+
+  // the destination read transposed by its own expression: owned,
+  // padded and a view of it
+  Matrix square (20, 20), padded (20, 20, Matrix::padded_ld (20));
+  fill (square, 23, 1);
+  for (int i = 0; i < 400; ++i) {
+    padded[i] = square[i];
+  }
+  Matrix expected_sym = square + MatrixView (square).transpose ();
+  Matrix owned (square), view (20, 20, padded.data (), padded.get_ld ());
+  owned = owned + MatrixView (owned).transpose ();
+  padded = padded + MatrixView (padded).transpose ();
+  for (int i = 0; i < 400; ++i) {
+    assert(owned[i] == expected_sym[i] && padded[i] == expected_sym[i]);
+  }
+  view = view.dot (MatrixView (view).transpose ());
+  for (int i = 0; i < 400; ++i) {
+    assert(padded[i] == expected_sym[i] * expected_sym[i]);
+  }
+
+  // the destination read as a block one row up or down: each row of the
+  // result reads the neighbouring stored row, which may be written first
+  const int r = 9, c = 7;
+  Matrix stored (r, c), shifted_down (r, c), shifted_up (r, c);
+  fill (stored, 24, 1);
+  shifted_down = stored;
+  shifted_up = stored;
+  Matrix lower (r - 1, c, shifted_down.data () + c, c);
+  lower = lower + MatrixView (shifted_down).block (0, 0, r - 1, c);
+  Matrix upper (r - 1, c, shifted_up.data (), c);
+  upper = upper + MatrixView (shifted_up).block (1, 0, r - 1, c);
+  for (int i = 0; i < r - 1; ++i) {
+    for (int j = 0; j < c; ++j) {
+      float expected_sum = stored (i, j) + stored (i + 1, j);
+      assert(shifted_down (i + 1, j) == expected_sum);
+      assert(shifted_up (i, j) == expected_sum);
+    }
+  }
+}
+
+/**
+ * This function checks that the operators of temporary matrices, which
+ * reuse the elements of owning matrices, copy views instead of writing
+ * into the elements they refer to.
+ */
+void test_temporary_views () {
+  float buffer[6] = {1, -2, 3, -4, 5, -6};
+  const float original[6] = {1, -2, 3, -4, 5, -6};
+  Matrix other (2, 3);
+  fill (other, 51, 1);
+  Matrix scaled = Matrix (2, 3, buffer) * 2.f;
+  Matrix scaled_left = 2.f * Matrix (2, 3, buffer);
+  Matrix sum = Matrix (2, 3, buffer) + other;
+  Matrix product = Matrix (2, 3, buffer).dot (other);
+  Matrix activated = Activation (SIGMOID) (Matrix (2, 3, buffer));
+  for (int i = 0; i < 6; ++i) {
+    assert(buffer[i] == original[i]);
+    assert(scaled[i] == original[i] * 2 && scaled_left[i] == scaled[i]);
+    assert(sum[i] == original[i] + other[i]);
+    assert(product[i] == original[i] * other[i]);
+    assert(activated[i] > 0 && activated[i] < 1);
+  }
+  assert(scaled.owns_data () && sum.owns_data () && product.owns_data ());
+}
+
+/**
+ * runs every test
+ * @return 0 when every test passes (a failing test exits with code 1)
+ */
+int main () {
+  test_alloc_counter ();
+  test_single_inference_no_alloc ();
+  test_batch_inference_no_alloc ();
+  test_batch_matches_single ();
+  test_static_matches_network ();
+  test_bundle_packed_panels ();
+  test_bundle_round_trip ();
+  test_bundle_rejects_truncated ();
+  test_bundle_rejects_bad_offsets ();
+  test_bundle_rejects_bad_columns ();
+  test_matrix_expressions ();
+  test_sparse_matches_dense ();
+  test_sparse_input_matches_dense ();
+  test_quantized_batch_matches_single ();
+  test_gemv_matches_gemm ();
+  test_gemm_matches_reference ();
+  test_padded_matrix ();
+  test_matrix_views ();
+  test_temporary_views ();
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,147 @@
+#ifndef TESTSUITE_H_
+#define TESTSUITE_H_
+
+#include "MlpNetwork.h"
+#include "AllocCounter.h"
+
+/**
+ * This function checks that the allocation counter sees operator new and
+ * operator delete.
+ * If the counts are wrong, an assert fails.
+ */
+void test_alloc_counter ();
+
+/**
+ * This function checks that a steady state MlpNetwork::operator () call
+ * does no heap allocation in any layer, for every weights precision.
+ * If a layer allocates, an assert fails.
+ */
+void test_single_inference_no_alloc ();
+
+/**
+ * This function checks that a steady state MlpNetwork::classify_batch call
+ * (into a caller buffer) does no heap allocation, for every weights
+ * precision and for batches up to the reserved size.
+ * If the batch allocates, an assert fails.
+ */
+void test_batch_inference_no_alloc ();
+
+/**
+ * This function checks that a batch gives the digits of single
+ * inferences of its images.
+ * If a digit differs, an assert fails.
+ */
+void test_batch_matches_single ();
+
+/**
+ * This function checks that StaticMlp gives the digits and probabilities
+ * of MlpNetwork for the default topology.
+ * If a digit or a probability differs, an assert fails.
+ */
+void test_static_matches_network ();
+
+/**
+ * This function checks that the float layers of a loaded bundle read its
+ * stored packed panels and match the loose weights.
+ * If the layers allocate a packed copy or an output differs, an assert
+ * fails.
+ */
+void test_bundle_packed_panels ();
+
+/**
+ * This function checks that float, 16 bit and sparse bundles load back
+ * the layers they were written from.
+ * If a loaded weight, bias or output differs, an assert fails.
+ */
+void test_bundle_round_trip ();
+
+/**
+ * This function checks that truncated bundles are rejected.
+ * If a truncated bundle loads, an assert fails.
+ */
+void test_bundle_rejects_truncated ();
+
+/**
+ * This function checks that bundles with a tensor offset out of the file
+ * or unaligned are rejected.
+ * If such a bundle loads, an assert fails.
+ */
+void test_bundle_rejects_bad_offsets ();
+
+/**
+ * This function checks that sparse bundles with a column index out of
+ * the layer are rejected.
+ * If such a bundle loads, an assert fails.
+ */
+void test_bundle_rejects_bad_columns ();
+
+/**
+ * This function checks that element-wise Matrix expressions give the
+ * element by element results and allocate only the result, and that
+ * assigning one to a view writes into the viewed elements.
+ * If an element or the allocations count differs, an assert fails.
+ */
+void test_matrix_expressions ();
+
+/**
+ * This function checks that sparse products match the dense products of
+ * the same pruned weights, for a vector and for batches.
+ * If an output differs, an assert fails.
+ */
+void test_sparse_matches_dense ();
+
+/**
+ * This function checks that single inputs mostly made of zeros give the
+ * outputs of the dense product when they skip their zeros.
+ * If an output differs, an assert fails.
+ */
+void test_sparse_input_matches_dense ();
+
+/**
+ * This function checks that int8 products of batches give the products of
+ * their single inputs, for full blocks of inputs and every tail.
+ * If an output differs, an assert fails.
+ */
+void test_quantized_batch_matches_single ();
+
+/**
+ * This function checks that the matrix-vector kernels give the products
+ * of the blocked gemm, for 1 to GEMV_MAX_VECTORS vectors.
+ * If an output differs, an assert fails.
+ */
+void test_gemv_matches_gemm ();
+
+/**
+ * This function checks that gemm, gemv and Matrix::operator* give the
+ * products of a naive triple loop, for sizes that are not multiples of
+ * the kernel tiles and for single rows and single columns.
+ * If an output differs, an assert fails.
+ */
+void test_gemm_matches_reference ();
+
+/**
+ * This function checks that a matrix with padded rows has aligned rows and
+ * gives the elements, expressions, products, activations, vectors and
+ * file reads of the same matrix without padding.
+ * If an element differs, an assert fails.
+ */
+void test_padded_matrix ();
+
+/**
+ * This function checks that views (blocks, rows, cols and transposes)
+ * read the elements of their matrix without copying them, and that the
+ * products and expressions of views match those of copied matrices, also
+ * when an expression reads its destination transposed or shifted.
+ * If an element differs or a view allocates, an assert fails.
+ */
+void test_matrix_views ();
+
+/**
+ * This function checks that the operators of temporary matrices (which
+ * reuse the elements of the matrix) and the activations of temporary
+ * matrices never write into the elements of a temporary view.
+ * If an element of the viewed buffer changes, an assert fails.
+ */
+void test_temporary_views ();
+
+#endif //TESTSUITE_H_